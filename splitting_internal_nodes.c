@@ -6,11 +6,60 @@
 #include<errno.h>
 #include<fcntl.h>
 #include<unistd.h>
+#include<sys/uio.h>
+#include<poll.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<sys/syscall.h>
+#include<linux/io_uring.h>
+#include<time.h>
+#if defined(__x86_64__)
+#include<immintrin.h>
+#endif
 
 #define MAX_USERNAME_CHAR 32
-#define MAX_EMAIL_CHAR 255
-#define MAX_TABLE_PAGES 100
+// Emails past a leaf's local payload limit spill into overflow pages, so they can be this long.
+#define MAX_EMAIL_CHAR 16384
+#define DEFAULT_POOL_FRAMES 256
+// A split pins the node, its new sibling and the parent at every level it climbs, plus a new root
+// and the overflow chain of the row being stored.
+#define MIN_POOL_FRAMES 24
 #define INVALID_PAGE_NUM UINT32_MAX
+// Page 0 holds the database header; a new tree starts at page 1, but its root can move.
+#define DB_HEADER_PAGE_NUM 0
+#define ROOT_PAGE_NUM 1
+#define DB_HEADER_MAGIC 0x53444231
+// Bumped whenever the on-disk layout changes, so old files are refused instead of misparsed.
+#define DB_FORMAT_VERSION 7
+#define INVALID_FRAME_NUM UINT32_MAX
+// Longest run of adjacent dirty pages written by a single pwritev call.
+#define FLUSH_MAX_IOVECS 256
+// Address space reserved for the memory-mapped pager; pages past it use the buffer pool.
+#define DEFAULT_MMAP_SIZE_MB 1024
+// Submission queue size of the io_uring engine, i.e. how many page I/Os may be in flight.
+#define IO_QUEUE_DEPTH 64
+// io_uring user_data bit marking a writeback; reads carry the index of their frame.
+#define IO_WRITE_TAG (1ull << 63)
+// A cursor that has crossed this many leaves is treated as a sequential scan...
+#define READAHEAD_TRIGGER_LEAVES 2
+// ...and keeps this many leaves ahead of it in flight.
+#define READAHEAD_WINDOW_LEAVES 8
+// Pages a bulk load builds in memory before writing them to the file with one pwrite.
+#define BULK_LOAD_RUN_PAGES 64
+// Deepest descent a cursor can record; fanout 510 reaches the 32-bit key space in far fewer levels.
+#define CURSOR_MAX_DEPTH 32
+// Key search narrows a node by bisection down to this many keys, then compares them all at once.
+#define KEY_SEARCH_WINDOW 16
+// Bloom filter (--bloom) sizing: bits per key it is built for and probes per key, about 1% false positives...
+#define BLOOM_BITS_PER_KEY 10
+#define BLOOM_NUM_HASHES 7
+// ...and the fewest keys it is ever sized for.
+#define BLOOM_MIN_KEYS 1024
+// Bytes of stdin read ahead per read(2) while looking for the end of a statement.
+#define INPUT_READ_CHUNK 4096
+#define WAL_RECORD_MAGIC 0x57414C31
+// Page images logged before the WAL is folded back into the database file.
+#define WAL_CHECKPOINT_PAGES 1000
 #define size_of_attribute(Struct, Attribute) sizeof(((Struct *)0)->Attribute)
 
 typedef enum
@@ -39,7 +88,12 @@ typedef enum
 {
     STATEMENT_SELECT,
     STATEMENT_SINGLE_SELECT,
-    STATEMENT_INSERT
+    STATEMENT_RANGE_SELECT,
+    STATEMENT_ORDERED_SELECT,
+    STATEMENT_COUNT,
+    STATEMENT_INSERT,
+    STATEMENT_DELETE,
+    STATEMENT_UPDATE
 } StatementType;
 
 typedef enum
@@ -50,19 +104,174 @@ typedef enum
     EXECUTE_TABLE_FULL
 } ExecuteResult;
 
+typedef enum
+{
+    WAL_PAGE_RECORD = 1,
+    WAL_COMMIT_RECORD = 2
+} WalRecordType;
+
+// Every WAL record starts with this header. A page record is followed by the page image.
 typedef struct {
-    void *pages[MAX_TABLE_PAGES];
-    uint32_t file_length;
-    uint32_t num_pages;
+    uint32_t magic;
+    uint32_t type;
+    // Page the image belongs to, or the database size in pages for a commit record.
+    uint32_t page_num;
+    uint32_t checksum;
+} WalRecordHeader;
+
+typedef struct {
+    char *filename;
     int file_descriptor;
+    // Appends go to file_length with pwrite; it is reset to 0 by every checkpoint.
+    off_t file_length;
+    // Page images appended since the last checkpoint.
+    uint32_t num_logged_pages;
+    // Commits are numbered in append order; durable_commit is the newest one fsynced.
+    uint64_t commits;
+    uint64_t durable_commit;
+    uint64_t checkpoints;
+    uint64_t syncs;
+    // Group commit: appended commits wait for a shared fdatasync until the batch holds
+    // max_batch commits or the oldest one has waited max_delay_ms.
+    uint32_t max_batch;
+    uint32_t max_delay_ms;
+    uint64_t oldest_pending_us;
+} Wal;
+
+// One coalesced run of dirty pages handed to io_uring as a single writev.
+typedef struct {
+    struct iovec *iov;
+    uint32_t iov_count;
+    off_t offset;
+    size_t length;
+} IoWrite;
 
+// Asynchronous page I/O through io_uring, driven with raw syscalls on the shared rings.
+typedef struct {
+    bool enabled;
+    int ring_fd;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    uint32_t sq_entries;
+    uint32_t *sq_tail;
+    uint32_t *sq_ring_mask;
+    uint32_t *sq_array;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t *cq_ring_mask;
+    struct io_uring_cqe *cqes;
+    // Queued in the submission ring but not yet passed to io_uring_enter.
+    uint32_t unsubmitted;
+    // Submitted and not yet reaped from the completion ring.
+    uint32_t in_flight;
+    // Writeback runs of the flush in progress, indexed by their user_data.
+    IoWrite *writes;
+    uint32_t writes_pending;
+    uint64_t reads_submitted;
+    uint64_t writes_submitted;
+} IoEngine;
+
+// One slot of the buffer pool. A frame is pinned while its pin_epoch equals the
+// pager's current epoch, i.e. it was fetched by the statement that is running now.
+typedef struct {
+    void *data;
+    uint32_t page_num;
+    bool reference_bit;
+    // Set by the mutation paths; only dirty frames are written back to the file.
+    bool is_dirty;
+    // Modified by the running statement and not yet logged, so it cannot be written back.
+    bool in_txn;
+    // Last commit that logged this page; it must be durable before the page is written back.
+    uint64_t commit_num;
+    // An asynchronous read into this frame has been submitted but has not completed yet.
+    bool io_pending;
+    uint64_t pin_epoch;
+} Frame;
+
+typedef struct {
+    Frame *frames;
+    uint32_t num_frames;
+    uint32_t clock_hand;
+    // page_num -> frame index lookup, INVALID_FRAME_NUM when the page isn't cached.
+    uint32_t *page_table;
+    uint32_t page_table_size;
+    uint64_t epoch;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t pages_written;
+    off_t file_length;
+    uint32_t num_pages;
+    int file_descriptor;
+    // Pages modified by the running statement, logged together by pager_commit.
+    uint32_t *txn_pages;
+    uint32_t txn_num_pages;
+    uint32_t txn_capacity;
+    Wal wal;
+    // Memory-mapped mode: pages below mapped_pages are served from a private mapping of
+    // the file, each tracked by its own entry in map_frames, and never use the pool.
+    bool use_mmap;
+    void *map_base;
+    size_t map_reserved_bytes;
+    uint32_t mapped_pages;
+    Frame *map_frames;
+    uint64_t map_hits;
+    IoEngine io;
+    uint64_t prefetches;
 } Pager;
 
+typedef struct {
+    uint32_t pool_frames;
+    uint32_t commit_batch;
+    uint32_t commit_delay_ms;
+    bool use_mmap;
+    uint32_t mmap_size_mb;
+    bool use_io_uring;
+    bool use_bloom;
+} DbOptions;
+
+/*
+In-memory Bloom filter over the table's ids, so lookups of absent ids can skip the descent.
+Deleted ids stay in it until the next rebuild; they only cost false positives.
+*/
+typedef struct {
+    uint64_t *bits;
+    // A power of two, so a probe is a mask.
+    uint32_t num_bits;
+    // Ids added since the last rebuild, and how many it was sized for.
+    uint32_t num_keys;
+    uint32_t capacity;
+    // Set when it no longer covers the table (at open, after a bulk load) or has outgrown its
+    // capacity; the next lookup rebuilds it from the leaves.
+    bool stale;
+    uint64_t lookups;
+    uint64_t skipped_descents;
+} BloomFilter;
+
+// One step of a root-to-leaf descent: the internal page and the child slot taken in it.
+typedef struct{
+    uint32_t page_num;
+    uint32_t child_num;
+} CursorPathEntry;
+
 typedef struct
 {
     uint32_t rows_count;
     Pager *pager;
     uint32_t root_page_num;
+    // Path to the rightmost leaf as of the last descent that ended there, and the largest key.
+    // Any split can reshape that path, so splits clear right_edge_valid.
+    bool right_edge_valid;
+    CursorPathEntry right_edge_path[CURSOR_MAX_DEPTH];
+    uint32_t right_edge_depth;
+    uint32_t right_edge_page_num;
+    uint32_t max_key;
+    // NULL unless opened with --bloom.
+    BloomFilter *bloom;
 } Table;
 
 typedef struct {
@@ -76,11 +285,27 @@ typedef struct {
     char* buffer;
     size_t buffer_size;
     ssize_t text_size;
+    // Bytes read from stdin past the current line; unread input is pending[pending_start, pending_end).
+    char* pending;
+    size_t pending_size;
+    size_t pending_start;
+    size_t pending_end;
 } InputBuffer;
 
 typedef struct {
     StatementType type;
     Row row_data;
+    // Inclusive id range of a range select or delete statement.
+    uint32_t range_start;
+    uint32_t range_end;
+    // Whether a full-table select prints the email; without it no overflow page is read.
+    bool select_email;
+    // Direction and row limit (UINT32_MAX = none) of an ordered select.
+    bool descending;
+    uint32_t limit;
+    // Columns an update assigns; the new values are in row_data.
+    bool set_username;
+    bool set_email;
 } Statement;
 
 typedef struct{
@@ -88,45 +313,73 @@ typedef struct{
     uint32_t page_num;
     uint32_t cell_num;
     bool end_of_table;
+    // Internal nodes above the leaf, root first. Only valid until the cursor leaves that leaf.
+    CursorPathEntry path[CURSOR_MAX_DEPTH];
+    uint32_t depth;
+    // Every step of the path took the last child, so the leaf is the rightmost one.
+    bool right_edge;
+    // Leaves crossed by cursor_advance, and whether every hop so far went forward in the file.
+    uint32_t leaves_visited;
+    bool ascending_leaves;
 } Cursor;
 
-const uint32_t ID_SIZE = size_of_attribute(Row, id);
-const uint32_t USERNAME_SIZE = size_of_attribute(Row, username);
-const uint32_t EMAIL_SIZE = size_of_attribute(Row, email);
-const uint32_t ID_OFFSET = 0;
-const uint32_t USERNAME_OFFSET = ID_OFFSET + ID_SIZE;
-const uint32_t EMAIL_OFFSET = USERNAME_OFFSET + USERNAME_SIZE;
-const uint32_t ROW_SIZE = ID_SIZE + USERNAME_SIZE + EMAIL_SIZE;
+// Row payload format => USERNAME_LENGTH, USERNAME, EMAIL_LENGTH, EMAIL. The id is the cell's key,
+// and strings are stored without padding or terminator, so a row takes only what it holds.
+const uint32_t ROW_FIELD_LENGTH_SIZE = sizeof(uint16_t);
+const uint32_t ROW_MAX_PAYLOAD_SIZE = 2 * ROW_FIELD_LENGTH_SIZE + MAX_USERNAME_CHAR + MAX_EMAIL_CHAR;
 const uint32_t PAGE_SIZE = 4096;
-const uint32_t ROWS_PER_PAGE = PAGE_SIZE / ROW_SIZE;
-const uint32_t TABLE_MAX_ROWS = ROWS_PER_PAGE * MAX_TABLE_PAGES;
 
-// Common Node header format => NODE_TYPE, IS_ROOT_NODE, NODE_PARENT_POINTER
+// Common Node header format => NODE_TYPE, IS_ROOT_NODE
+// Nodes keep no parent pointer: a cursor's descent path says who the parent is.
 const uint32_t NODE_TYPE_SIZE = sizeof(uint8_t);
 const uint32_t NODE_TYPE_OFFSET = 0;
 const uint32_t IS_NODE_ROOT_SIZE = sizeof(uint8_t);
 const uint32_t IS_NODE_ROOT_OFFSET = NODE_TYPE_OFFSET + NODE_TYPE_SIZE;
-const uint32_t NODE_PARENT_POINTER_SIZE = sizeof(uint32_t);
-const uint32_t NODE_PARENT_POINTER_OFFSET = IS_NODE_ROOT_OFFSET + IS_NODE_ROOT_SIZE;
-const uint32_t COMMON_NODE_HEADER_SIZE = NODE_TYPE_SIZE + IS_NODE_ROOT_SIZE + NODE_PARENT_POINTER_SIZE;
+const uint32_t COMMON_NODE_HEADER_SIZE = NODE_TYPE_SIZE + IS_NODE_ROOT_SIZE;
 
-// Leaf Node Header format => COMMON_NODE_HEADER, LEAF_CELLS_COUNT
+// Leaf Node Header format => COMMON_NODE_HEADER, LEAF_CELLS_COUNT, NEXT_LEAF, PREV_LEAF (0 = none),
+// CONTENT_START (lowest byte used by a value; PAGE_SIZE when the leaf is empty)
 const uint32_t LEAF_NODE_CELLS_COUNT_SIZE = sizeof(uint32_t);
 const uint32_t LEAF_NODE_CELLS_COUNT_OFFSET = COMMON_NODE_HEADER_SIZE;
 const uint32_t LEAF_NODE_NEXT_LEAF_SIZE = sizeof(uint32_t);
 const uint32_t LEAF_NODE_NEXT_LEAF_OFFSET = LEAF_NODE_CELLS_COUNT_OFFSET + LEAF_NODE_CELLS_COUNT_SIZE;
-const uint32_t LEAF_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + LEAF_NODE_CELLS_COUNT_SIZE + LEAF_NODE_NEXT_LEAF_SIZE;
-
-// Leaf Node Body format => Key, Value
+const uint32_t LEAF_NODE_PREV_LEAF_SIZE = sizeof(uint32_t);
+const uint32_t LEAF_NODE_PREV_LEAF_OFFSET = LEAF_NODE_NEXT_LEAF_OFFSET + LEAF_NODE_NEXT_LEAF_SIZE;
+const uint32_t LEAF_NODE_CONTENT_START_SIZE = sizeof(uint32_t);
+const uint32_t LEAF_NODE_CONTENT_START_OFFSET = LEAF_NODE_PREV_LEAF_OFFSET + LEAF_NODE_PREV_LEAF_SIZE;
+const uint32_t LEAF_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + LEAF_NODE_CELLS_COUNT_SIZE + LEAF_NODE_NEXT_LEAF_SIZE + LEAF_NODE_PREV_LEAF_SIZE + LEAF_NODE_CONTENT_START_SIZE;
+
+/*
+Leaf Node Body format => Keys[MAX_CELLS], Value Offsets[MAX_CELLS], free space, Values. Cell i is
+key i plus the row payload at offset i; payloads are packed against the end of the page and grow
+down towards the slots. Searches and id-only scans read just the dense key array.
+*/
 const uint32_t LEAF_NODE_KEY_SIZE = sizeof(uint32_t);
-const uint32_t LEAF_NODE_KEY_OFFSET = 0;
-const uint32_t LEAF_NODE_VALUE_SIZE = ROW_SIZE;
-const uint32_t LEAF_NODE_VALUE_OFFSET = LEAF_NODE_KEY_OFFSET + LEAF_NODE_KEY_SIZE;
-const uint32_t LEAF_NODE_CELL_SIZE = LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE;
+const uint32_t LEAF_NODE_SLOT_SIZE = sizeof(uint16_t);
 const uint32_t LEAF_NODE_CELL_SPACE = PAGE_SIZE - LEAF_NODE_HEADER_SIZE;
-const uint32_t LEAF_NODE_MAX_CELLS = LEAF_NODE_CELL_SPACE / LEAF_NODE_CELL_SIZE;
-const uint32_t LEAF_NODE_SPLIT_RIGHT_NUM_CELLS = (LEAF_NODE_MAX_CELLS + 1) / 2;
-const uint32_t LEAF_NODE_SPLIT_LEFT_NUM_CELLS = (LEAF_NODE_MAX_CELLS + 1) - LEAF_NODE_SPLIT_RIGHT_NUM_CELLS;
+// Cap on rows per leaf. Typical rows are a few dozen bytes, so the value space fills near it.
+const uint32_t LEAF_NODE_MAX_CELLS = 128;
+const uint32_t LEAF_NODE_KEYS_OFFSET = LEAF_NODE_HEADER_SIZE;
+const uint32_t LEAF_NODE_SLOTS_OFFSET = LEAF_NODE_KEYS_OFFSET + LEAF_NODE_MAX_CELLS * LEAF_NODE_KEY_SIZE;
+const uint32_t LEAF_NODE_VALUE_SPACE_OFFSET = LEAF_NODE_SLOTS_OFFSET + LEAF_NODE_MAX_CELLS * LEAF_NODE_SLOT_SIZE;
+const uint32_t LEAF_NODE_VALUE_SPACE = PAGE_SIZE - LEAF_NODE_VALUE_SPACE_OFFSET;
+// A non-root leaf below both of these borrows from or merges with a sibling after a delete.
+const uint32_t LEAF_NODE_MIN_CELLS = LEAF_NODE_MAX_CELLS / 4;
+const uint32_t LEAF_NODE_MIN_VALUE_BYTES = LEAF_NODE_VALUE_SPACE / 4;
+/*
+A payload longer than LEAF_NODE_MAX_LOCAL keeps its first LEAF_NODE_SPILL_LOCAL_BYTES in the leaf,
+followed by the page number of an overflow chain holding the rest, as SQLite does. The username
+and the email's length always stay local, so only reading the email touches the chain.
+*/
+const uint32_t LEAF_NODE_MAX_LOCAL = LEAF_NODE_VALUE_SPACE / 8;
+const uint32_t LEAF_NODE_OVERFLOW_POINTER_SIZE = sizeof(uint32_t);
+const uint32_t LEAF_NODE_SPILL_LOCAL_BYTES = LEAF_NODE_MAX_LOCAL - LEAF_NODE_OVERFLOW_POINTER_SIZE;
+
+// Overflow Page format => NEXT_OVERFLOW_PAGE (0 = last), payload bytes
+const uint32_t OVERFLOW_PAGE_NEXT_SIZE = sizeof(uint32_t);
+const uint32_t OVERFLOW_PAGE_NEXT_OFFSET = 0;
+const uint32_t OVERFLOW_PAGE_DATA_OFFSET = OVERFLOW_PAGE_NEXT_OFFSET + OVERFLOW_PAGE_NEXT_SIZE;
+const uint32_t OVERFLOW_PAGE_DATA_SIZE = PAGE_SIZE - OVERFLOW_PAGE_DATA_OFFSET;
 
 // Internal Node Header Format => NumOfKeys, RightChildPointer..
 const uint32_t INTERNAL_NODE_NUM_KEYS_SIZE = sizeof(uint32_t);
@@ -135,14 +388,44 @@ const uint32_t INTERNAL_NODE_RIGHT_CHILD_SIZE = sizeof(uint32_t);
 const uint32_t INTERNAL_NODE_RIGHT_CHILD_OFFSET = INTERNAL_NODE_NUM_KEYS_OFFSET + INTERNAL_NODE_NUM_KEYS_SIZE;
 const uint32_t INTERNAL_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + INTERNAL_NODE_NUM_KEYS_SIZE + INTERNAL_NODE_RIGHT_CHILD_SIZE;
 
-// Internal Node Body Format => Child Pointer, (Max Key from Left Child)Key Value
+// Internal Node Body Format => Keys[MAX_CELLS], Child Pointers[MAX_CELLS]; cell i is key i and child i.
+// Keys are packed contiguously so a search touches a few cache lines and can compare them in SIMD.
 const uint32_t INTERNAL_NODE_CHILD_SIZE = sizeof(uint32_t);
 const uint32_t INTERNAL_NODE_KEY_SIZE = sizeof(uint32_t);
 const uint32_t INTERNAL_NODE_CELL_SIZE = INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_KEY_SIZE;
-// const uint32_t INTERNAL_NODE_MAX_CELLS = (PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE) / INTERNAL_NODE_CELL_SIZE;
-const uint32_t INTERNAL_NODE_MAX_CELLS = 3;
-
-void internal_node_split_and_insert(Table* table, uint32_t parent_page_num, uint32_t child_page_num);
+const uint32_t INTERNAL_NODE_MAX_CELLS = (PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE) / INTERNAL_NODE_CELL_SIZE;
+const uint32_t INTERNAL_NODE_MIN_KEYS = INTERNAL_NODE_MAX_CELLS / 2;
+const uint32_t INTERNAL_NODE_KEYS_OFFSET = INTERNAL_NODE_HEADER_SIZE;
+const uint32_t INTERNAL_NODE_CHILDREN_OFFSET = INTERNAL_NODE_KEYS_OFFSET + INTERNAL_NODE_MAX_CELLS * INTERNAL_NODE_KEY_SIZE;
+
+// Database Header format (page 0) => MAGIC, FORMAT_VERSION, PAGE_SIZE, ROOT_PAGE, PAGE_COUNT,
+// ROW_COUNT, FREELIST_HEAD, FREE_PAGE_COUNT
+const uint32_t DB_HEADER_MAGIC_SIZE = sizeof(uint32_t);
+const uint32_t DB_HEADER_MAGIC_OFFSET = 0;
+const uint32_t DB_HEADER_FORMAT_VERSION_SIZE = sizeof(uint32_t);
+const uint32_t DB_HEADER_FORMAT_VERSION_OFFSET = DB_HEADER_MAGIC_OFFSET + DB_HEADER_MAGIC_SIZE;
+const uint32_t DB_HEADER_PAGE_SIZE_SIZE = sizeof(uint32_t);
+const uint32_t DB_HEADER_PAGE_SIZE_OFFSET = DB_HEADER_FORMAT_VERSION_OFFSET + DB_HEADER_FORMAT_VERSION_SIZE;
+const uint32_t DB_HEADER_ROOT_PAGE_SIZE = sizeof(uint32_t);
+const uint32_t DB_HEADER_ROOT_PAGE_OFFSET = DB_HEADER_PAGE_SIZE_OFFSET + DB_HEADER_PAGE_SIZE_SIZE;
+const uint32_t DB_HEADER_PAGE_COUNT_SIZE = sizeof(uint32_t);
+const uint32_t DB_HEADER_PAGE_COUNT_OFFSET = DB_HEADER_ROOT_PAGE_OFFSET + DB_HEADER_ROOT_PAGE_SIZE;
+const uint32_t DB_HEADER_ROW_COUNT_SIZE = sizeof(uint32_t);
+const uint32_t DB_HEADER_ROW_COUNT_OFFSET = DB_HEADER_PAGE_COUNT_OFFSET + DB_HEADER_PAGE_COUNT_SIZE;
+const uint32_t DB_HEADER_FREELIST_HEAD_SIZE = sizeof(uint32_t);
+const uint32_t DB_HEADER_FREELIST_HEAD_OFFSET = DB_HEADER_ROW_COUNT_OFFSET + DB_HEADER_ROW_COUNT_SIZE;
+const uint32_t DB_HEADER_FREE_PAGE_COUNT_SIZE = sizeof(uint32_t);
+const uint32_t DB_HEADER_FREE_PAGE_COUNT_OFFSET = DB_HEADER_FREELIST_HEAD_OFFSET + DB_HEADER_FREELIST_HEAD_SIZE;
+
+// Freelist Trunk page format => NEXT_TRUNK, NUM_LEAVES, free (leaf) page numbers..
+const uint32_t FREELIST_TRUNK_NEXT_SIZE = sizeof(uint32_t);
+const uint32_t FREELIST_TRUNK_NEXT_OFFSET = 0;
+const uint32_t FREELIST_TRUNK_NUM_LEAVES_SIZE = sizeof(uint32_t);
+const uint32_t FREELIST_TRUNK_NUM_LEAVES_OFFSET = FREELIST_TRUNK_NEXT_OFFSET + FREELIST_TRUNK_NEXT_SIZE;
+const uint32_t FREELIST_TRUNK_HEADER_SIZE = FREELIST_TRUNK_NEXT_SIZE + FREELIST_TRUNK_NUM_LEAVES_SIZE;
+const uint32_t FREELIST_TRUNK_MAX_LEAVES = (PAGE_SIZE - FREELIST_TRUNK_HEADER_SIZE) / sizeof(uint32_t);
+
+void internal_node_split_and_insert(Cursor* cursor, uint32_t level, uint32_t left_child_max_key, uint32_t new_child_page_num);
 
 NodeType get_node_type(void* node){
     uint8_t type = *((uint8_t *)(node + NODE_TYPE_OFFSET));
@@ -173,8 +456,9 @@ uint32_t* internal_node_right_child(void* node){
     return node + INTERNAL_NODE_RIGHT_CHILD_OFFSET;
 }
 
+// The child slot of a cell, without the bounds and validity checks of internal_node_child.
 uint32_t* internal_node_cell(void *node, uint32_t cell_num){
-    return node + INTERNAL_NODE_HEADER_SIZE + cell_num * INTERNAL_NODE_CELL_SIZE;
+    return node + INTERNAL_NODE_CHILDREN_OFFSET + cell_num * INTERNAL_NODE_CHILD_SIZE;
 }
 
 uint32_t* internal_node_child(void* node, uint32_t cell_num){
@@ -201,7 +485,13 @@ uint32_t* internal_node_child(void* node, uint32_t cell_num){
 }
 
 uint32_t* internal_node_key(void* node, uint32_t cell_num){
-    return (void*)internal_node_cell(node, cell_num) + INTERNAL_NODE_CHILD_SIZE;
+    return node + INTERNAL_NODE_KEYS_OFFSET + cell_num * INTERNAL_NODE_KEY_SIZE;
+}
+
+// Moves count cells (keys and child slots) between nodes or within one; ranges may overlap.
+void internal_node_move_cells(void* dest_node, uint32_t dest_cell, void* src_node, uint32_t src_cell, uint32_t count){
+    memmove(internal_node_key(dest_node, dest_cell), internal_node_key(src_node, src_cell), count * INTERNAL_NODE_KEY_SIZE);
+    memmove(internal_node_cell(dest_node, dest_cell), internal_node_cell(src_node, src_cell), count * INTERNAL_NODE_CHILD_SIZE);
 }
 
 uint32_t* internal_node_max_key(void* node){
@@ -209,9 +499,62 @@ uint32_t* internal_node_max_key(void* node){
     return internal_node_key(node, num_keys - 1);
 }
 
-// Accessing parent node..
-uint32_t* get_parent_node(void* node){
-    return node + NODE_PARENT_POINTER_OFFSET;
+// Accessing database header fields..
+uint32_t* db_header_magic(void* header){
+    return header + DB_HEADER_MAGIC_OFFSET;
+}
+
+uint32_t* db_header_format_version(void* header){
+    return header + DB_HEADER_FORMAT_VERSION_OFFSET;
+}
+
+uint32_t* db_header_page_size(void* header){
+    return header + DB_HEADER_PAGE_SIZE_OFFSET;
+}
+
+uint32_t* db_header_root_page(void* header){
+    return header + DB_HEADER_ROOT_PAGE_OFFSET;
+}
+
+uint32_t* db_header_page_count(void* header){
+    return header + DB_HEADER_PAGE_COUNT_OFFSET;
+}
+
+uint32_t* db_header_row_count(void* header){
+    return header + DB_HEADER_ROW_COUNT_OFFSET;
+}
+
+uint32_t* db_header_freelist_head(void* header){
+    return header + DB_HEADER_FREELIST_HEAD_OFFSET;
+}
+
+uint32_t* db_header_free_page_count(void* header){
+    return header + DB_HEADER_FREE_PAGE_COUNT_OFFSET;
+}
+
+void initialize_db_header(void* header){
+    memset(header, 0, PAGE_SIZE);
+    *(db_header_magic(header)) = DB_HEADER_MAGIC;
+    *(db_header_format_version(header)) = DB_FORMAT_VERSION;
+    *(db_header_page_size(header)) = PAGE_SIZE;
+    *(db_header_root_page(header)) = ROOT_PAGE_NUM;
+    *(db_header_page_count(header)) = 1;
+    *(db_header_row_count(header)) = 0;
+    *(db_header_freelist_head(header)) = 0;
+    *(db_header_free_page_count(header)) = 0;
+}
+
+// Accessing freelist trunk pages..
+uint32_t* freelist_trunk_next(void* trunk){
+    return trunk + FREELIST_TRUNK_NEXT_OFFSET;
+}
+
+uint32_t* freelist_trunk_num_leaves(void* trunk){
+    return trunk + FREELIST_TRUNK_NUM_LEAVES_OFFSET;
+}
+
+uint32_t* freelist_trunk_leaf(void* trunk, uint32_t leaf_num){
+    return trunk + FREELIST_TRUNK_HEADER_SIZE + leaf_num * sizeof(uint32_t);
 }
 
 // Accessing Leaf Node fields..
@@ -219,12 +562,8 @@ uint32_t* leaf_node_num_cells(void* node){
     return node + LEAF_NODE_CELLS_COUNT_OFFSET;
 }
 
-void* leaf_node_cell(void* node, uint32_t cell_num){
-    return node + LEAF_NODE_HEADER_SIZE + cell_num * LEAF_NODE_CELL_SIZE;
-}
-
 uint32_t* leaf_node_key(void* node, uint32_t cell_num){
-    return leaf_node_cell(node, cell_num);
+    return node + LEAF_NODE_KEYS_OFFSET + cell_num * LEAF_NODE_KEY_SIZE;
 }
 
 uint32_t* leaf_node_max_key(void* node){
@@ -232,20 +571,52 @@ uint32_t* leaf_node_max_key(void* node){
     return leaf_node_key(node, num_node_cells - 1);
 }
 
+uint16_t* leaf_node_slot(void* node, uint32_t cell_num){
+    return node + LEAF_NODE_SLOTS_OFFSET + cell_num * LEAF_NODE_SLOT_SIZE;
+}
+
 void* leaf_node_value(void* node, uint32_t cell_num){
-    return leaf_node_cell(node, cell_num) + LEAF_NODE_KEY_SIZE;
+    return node + *(leaf_node_slot(node, cell_num));
+}
+
+uint32_t* leaf_node_content_start(void* node){
+    return node + LEAF_NODE_CONTENT_START_OFFSET;
+}
+
+// Value bytes in use; values are kept packed, so this is also the free space's complement.
+uint32_t leaf_node_used_space(void* node){
+    return PAGE_SIZE - *(leaf_node_content_start(node));
+}
+
+bool leaf_node_has_room(void* node, uint32_t num_cells, uint32_t value_bytes){
+    return *(leaf_node_num_cells(node)) + num_cells <= LEAF_NODE_MAX_CELLS &&
+           leaf_node_used_space(node) + value_bytes <= LEAF_NODE_VALUE_SPACE;
+}
+
+bool leaf_node_underfull(void* node){
+    return *(leaf_node_num_cells(node)) < LEAF_NODE_MIN_CELLS && leaf_node_used_space(node) < LEAF_NODE_MIN_VALUE_BYTES;
+}
+
+uint32_t* overflow_next_page(void* page){
+    return page + OVERFLOW_PAGE_NEXT_OFFSET;
 }
 
 uint32_t* leaf_next_leaf_node(void* node){
     return node + LEAF_NODE_NEXT_LEAF_OFFSET;
 }
 
+uint32_t* leaf_prev_leaf_node(void* node){
+    return node + LEAF_NODE_PREV_LEAF_OFFSET;
+}
+
 void initialize_leaf_node(void* node){
     set_node_type(node, NODE_LEAF);
     set_is_root(node, false);
     uint32_t *num_cells_node = leaf_node_num_cells(node);
     *num_cells_node = 0;
     *(leaf_next_leaf_node(node)) = 0;
+    *(leaf_prev_leaf_node(node)) = 0;
+    *(leaf_node_content_start(node)) = PAGE_SIZE;
 }
 
 void initialize_internal_node(void* node){
@@ -255,466 +626,1907 @@ void initialize_internal_node(void* node){
     *(internal_node_right_child(node)) = INVALID_PAGE_NUM;
 }
 
-void *get_page(Pager *pager, uint32_t page_num){
-    if(page_num > MAX_TABLE_PAGES){
-        printf("Error: page_num out of bound %d\n", page_num);
-        exit(EXIT_FAILURE);
+/*
+Positional I/O helpers. pread/pwrite never touch the shared file offset, so any number
+of readers and flushers can use one descriptor. The kernel may transfer fewer bytes than
+asked for (or be interrupted), so each helper loops until the whole range is done.
+*/
+size_t pread_full(int fd, void *buffer, size_t length, off_t offset){
+    size_t total_read = 0;
+    while(total_read < length){
+        ssize_t bytes_read = pread(fd, (char *)buffer + total_read, length - total_read, offset + total_read);
+        if(bytes_read == -1 && errno == EINTR){
+            continue;
+        }
+        if(bytes_read == -1){
+            printf("Error: reading from file on disk %d \n", errno);
+            exit(EXIT_FAILURE);
+        }
+        if(bytes_read == 0){
+            // End of file, the caller decides what a short page means.
+            break;
+        }
+        total_read += bytes_read;
     }
+    return total_read;
+}
 
-    if(pager->pages[page_num] == NULL){
-        void *page = (void *)malloc(PAGE_SIZE);
-
-        uint32_t num_pages_file = pager->file_length / PAGE_SIZE;
-
-        // If we have partial filled page stored in file, add that as well.
-        if((pager->file_length) % PAGE_SIZE > 0){
-            num_pages_file++;
+void pwrite_full(int fd, const void *buffer, size_t length, off_t offset){
+    size_t total_written = 0;
+    while(total_written < length){
+        ssize_t bytes_written = pwrite(fd, (const char *)buffer + total_written, length - total_written, offset + total_written);
+        if(bytes_written == -1 && errno == EINTR){
+            continue;
+        }
+        if(bytes_written == -1){
+            printf("Error: writing to file on disk %d\n", errno);
+            exit(EXIT_FAILURE);
         }
+        total_written += bytes_written;
+    }
+}
 
-        if(page_num <= num_pages_file){
-            lseek(pager->file_descriptor, page_num * PAGE_SIZE, SEEK_SET);
-            ssize_t bytes_read = read(pager->file_descriptor, page, PAGE_SIZE);
-            if(bytes_read == -1){
-                printf("Error: reading page from file on disk %d \n", errno);
-                exit(EXIT_FAILURE);
-            }
+// Consumes iov while writing; a short pwritev resumes from the first unwritten byte.
+void pwritev_full(int fd, struct iovec *iov, int iovcnt, off_t offset){
+    while(iovcnt > 0){
+        ssize_t bytes_written = pwritev(fd, iov, iovcnt, offset);
+        if(bytes_written == -1 && errno == EINTR){
+            continue;
+        }
+        if(bytes_written == -1){
+            printf("Error: writing pages to file on disk %d\n", errno);
+            exit(EXIT_FAILURE);
         }
-        pager->pages[page_num] = page;
 
-        if(page_num >= pager->num_pages){
-            pager->num_pages = page_num + 1;
+        offset += bytes_written;
+        while(iovcnt > 0 && (size_t)bytes_written >= iov->iov_len){
+            bytes_written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if(iovcnt > 0){
+            iov->iov_base = (char *)iov->iov_base + bytes_written;
+            iov->iov_len -= bytes_written;
         }
     }
-
-    return pager->pages[page_num];
 }
 
-void serialize_row_data(Row* row_data, void* row_slot){
-    memcpy(row_slot + ID_OFFSET, &(row_data->id), ID_SIZE);
-    memcpy(row_slot + USERNAME_OFFSET, row_data->username, USERNAME_SIZE);
-    memcpy(row_slot + EMAIL_OFFSET, row_data->email, EMAIL_SIZE);
-}
+void write_page_to_disk(Pager *pager, uint32_t page_num, void *page){
+    pwrite_full(pager->file_descriptor, page, PAGE_SIZE, (off_t)page_num * PAGE_SIZE);
 
-void deserialize_row_data(Row* destination,void* source){
-    memcpy(&(destination->id), source + ID_OFFSET, ID_SIZE);
-    memcpy(&(destination->username), source + USERNAME_OFFSET, USERNAME_SIZE);
-    memcpy(&(destination->email), source + EMAIL_OFFSET, EMAIL_SIZE);
+    // Evicted pages can extend the file, and must be read back from it later.
+    if((off_t)(page_num + 1) * PAGE_SIZE > pager->file_length){
+        pager->file_length = (off_t)(page_num + 1) * PAGE_SIZE;
+    }
+    pager->pages_written++;
 }
 
-uint32_t get_new_unused_page_num(Pager* pager){
-    return pager->num_pages;
+// Writes count consecutive pages that bypass the pool, such as pages built by a bulk load.
+void write_pages_to_disk(Pager *pager, uint32_t first_page_num, void *pages, uint32_t count){
+    pwrite_full(pager->file_descriptor, pages, (size_t)count * PAGE_SIZE, (off_t)first_page_num * PAGE_SIZE);
+    if((off_t)(first_page_num + count) * PAGE_SIZE > pager->file_length){
+        pager->file_length = (off_t)(first_page_num + count) * PAGE_SIZE;
+    }
+    pager->pages_written += count;
 }
 
-uint32_t get_node_max_key(Pager* pager, void* node){
-    if(get_node_type(node) == NODE_LEAF){
-        return *(leaf_node_key(node, *(leaf_node_num_cells(node)) - 1));
+// Returns the frame caching page_num, either in the mapping or in the pool, or NULL.
+Frame *lookup_frame(Pager *pager, uint32_t page_num){
+    if(page_num < pager->mapped_pages){
+        return &(pager->map_frames[page_num]);
+    }
+    if(page_num < pager->page_table_size && pager->page_table[page_num] != INVALID_FRAME_NUM){
+        return &(pager->frames[pager->page_table[page_num]]);
     }
-    void *right_child = get_page(pager, *(internal_node_right_child(node)));
-    return get_node_max_key(pager, right_child);
+    return NULL;
 }
 
-void create_new_root(Table* table, uint32_t right_child_page_num){
-    void *root_node = get_page(table->pager, table->root_page_num);
-    void* right_node = get_page(table->pager, right_child_page_num);
-    uint32_t new_left_node_page_num = get_new_unused_page_num(table->pager);
-    void *left_node = get_page(table->pager, new_left_node_page_num);
+void flush_page_to_disk(Pager *pager, uint32_t page_num){
+    Frame *frame = lookup_frame(pager, page_num);
+    if (frame == NULL)
+    {
+        printf("Error: Pages not present in buffer pool cannot be flushed to disk\n");
+        exit(EXIT_FAILURE);
+    }
 
-    if(get_node_type(root_node) == NODE_INTERNAL){
-        initialize_internal_node(right_node);
-        initialize_internal_node(left_node);
+    if(frame->is_dirty){
+        write_page_to_disk(pager, page_num, frame->data);
+        frame->is_dirty = false;
     }
+}
 
-    memcpy(left_node, root_node, PAGE_SIZE);
-    set_is_root(left_node, false);
+void mark_page_dirty(Pager *pager, uint32_t page_num){
+    Frame *frame = lookup_frame(pager, page_num);
+    if (frame == NULL)
+    {
+        printf("Error: Pages not present in buffer pool cannot be marked dirty\n");
+        exit(EXIT_FAILURE);
+    }
+    frame->is_dirty = true;
 
-    if(get_node_type(left_node) == NODE_INTERNAL){
-        void *child_node;
-        for (int32_t i = 0; i < *(internal_node_num_keys(left_node)); i++)
-        {
-            child_node = get_page(table->pager, *(internal_node_child(left_node, i)));
-            *(get_parent_node(child_node)) = new_left_node_page_num;
+    if(!frame->in_txn){
+        if(pager->txn_num_pages == pager->txn_capacity){
+            pager->txn_capacity = pager->txn_capacity == 0 ? 16 : pager->txn_capacity * 2;
+            pager->txn_pages = realloc(pager->txn_pages, pager->txn_capacity * sizeof(uint32_t));
         }
-        child_node = get_page(table->pager, *(internal_node_right_child(left_node)));
-        *(get_parent_node(child_node)) = new_left_node_page_num;
+        pager->txn_pages[pager->txn_num_pages++] = page_num;
+        frame->in_txn = true;
     }
-
-    /* Root node is new internal node with 1 Key and 2 children pointers */
-    initialize_internal_node(root_node);
-    set_is_root(root_node, true);
-    *(internal_node_num_keys(root_node)) = 1;
-    *(internal_node_right_child(root_node)) = right_child_page_num;
-    uint32_t left_child_max_key = get_node_max_key(table->pager, left_node);
-    *(internal_node_child(root_node, 0)) = new_left_node_page_num;
-    *(internal_node_key(root_node, 0)) = left_child_max_key;
-
-    *(get_parent_node(left_node)) = table->root_page_num;
-    *(get_parent_node(right_node)) = table->root_page_num;
 }
 
-uint32_t internal_node_find_child(void* internal_node,uint32_t key){
-    uint32_t num_keys_node = *(internal_node_num_keys(internal_node));
-    uint32_t min_key_id = 0, max_key_id = num_keys_node;
-
-    while(min_key_id != max_key_id){
-        uint32_t mid_key_id = (min_key_id + max_key_id) / 2;
-        uint32_t cell_key_val = *(internal_node_key(internal_node, mid_key_id));
+/*
+Sets up an io_uring instance and maps its submission and completion rings. Returns false
+when the kernel (or a seccomp policy) refuses, so the pager can stay synchronous.
+*/
+bool io_engine_setup(IoEngine *engine){
+    memset(engine, 0, sizeof(IoEngine));
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ring_fd = syscall(__NR_io_uring_setup, IO_QUEUE_DEPTH, &params);
+    if(ring_fd < 0){
+        return false;
+    }
 
-        if(cell_key_val == key){
-            break;
-        }else if(cell_key_val > key){
-            max_key_id = mid_key_id;
-        }else{
-            min_key_id = mid_key_id + 1;
+    engine->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    engine->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(single_mmap){
+        if(engine->cq_ring_size > engine->sq_ring_size){
+            engine->sq_ring_size = engine->cq_ring_size;
         }
+        engine->cq_ring_size = engine->sq_ring_size;
     }
 
-    return min_key_id;
-}
+    engine->sq_ring = mmap(NULL, engine->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    engine->cq_ring = single_mmap ? engine->sq_ring :
+                      mmap(NULL, engine->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    engine->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    engine->sqes = mmap(NULL, engine->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if(engine->sq_ring == MAP_FAILED || engine->cq_ring == MAP_FAILED || engine->sqes == MAP_FAILED){
+        close(ring_fd);
+        return false;
+    }
 
-void update_internal_node_key(void* node,uint32_t old_key_val,uint32_t new_key_val){
-    uint32_t key_cell_id = internal_node_find_child(node, old_key_val);
-    *(internal_node_key(node, key_cell_id)) = new_key_val;
+    engine->sq_tail = engine->sq_ring + params.sq_off.tail;
+    engine->sq_ring_mask = engine->sq_ring + params.sq_off.ring_mask;
+    engine->sq_array = engine->sq_ring + params.sq_off.array;
+    engine->cq_head = engine->cq_ring + params.cq_off.head;
+    engine->cq_tail = engine->cq_ring + params.cq_off.tail;
+    engine->cq_ring_mask = engine->cq_ring + params.cq_off.ring_mask;
+    engine->cqes = engine->cq_ring + params.cq_off.cqes;
+    engine->sq_entries = params.sq_entries;
+    engine->ring_fd = ring_fd;
+    engine->enabled = true;
+    return true;
 }
 
-void internal_node_insert(Table* table,uint32_t parent_page_num,uint32_t new_page_num){
-    void* parent_node = get_page(table->pager, parent_page_num);
-    void *new_child_node = get_page(table->pager, new_page_num);
-
-    uint32_t child_node_max_key = get_node_max_key(table->pager, new_child_node);
-
-    uint32_t child_node_index = internal_node_find_child(parent_node, child_node_max_key);
+void io_engine_close(IoEngine *engine){
+    if(!engine->enabled){
+        return;
+    }
+    munmap(engine->sqes, engine->sqes_size);
+    if(engine->cq_ring != engine->sq_ring){
+        munmap(engine->cq_ring, engine->cq_ring_size);
+    }
+    munmap(engine->sq_ring, engine->sq_ring_size);
+    close(engine->ring_fd);
+    engine->enabled = false;
+}
 
-    uint32_t num_keys_in_parent = *(internal_node_num_keys(parent_node));
+// Hands every queued SQE to the kernel.
+void io_engine_submit(IoEngine *engine){
+    while(engine->unsubmitted > 0){
+        int submitted = syscall(__NR_io_uring_enter, engine->ring_fd, engine->unsubmitted, 0, 0, NULL, 0);
+        if(submitted == -1 && errno == EINTR){
+            continue;
+        }
+        if(submitted == -1){
+            printf("Error: submitting asynchronous page I/O %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+        engine->unsubmitted -= submitted;
+        engine->in_flight += submitted;
+    }
+}
 
-    if(num_keys_in_parent >= INTERNAL_NODE_MAX_CELLS){
-        internal_node_split_and_insert(table, parent_page_num, new_page_num);
+void io_engine_complete(Pager *pager, uint64_t user_data, int32_t result){
+    if(result < 0){
+        printf("Error: asynchronous page I/O failed %d\n", -result);
+        exit(EXIT_FAILURE);
     }
-    else
-    {
-        uint32_t rightmost_child_page_num = *(internal_node_right_child(parent_node));
-        /* An internal node with a right child of INVALID_PAGE_NUM is empty */
-        if (rightmost_child_page_num == INVALID_PAGE_NUM) {
-            *internal_node_right_child(parent_node) = new_page_num;
-            return;
+
+    if(user_data & IO_WRITE_TAG){
+        IoWrite *write = &(pager->io.writes[user_data & ~IO_WRITE_TAG]);
+        // Rare short write: the iovecs are untouched, so rewrite the whole run synchronously.
+        if((size_t)result < write->length){
+            pwritev_full(pager->file_descriptor, write->iov, write->iov_count, write->offset);
         }
+        pager->io.writes_pending--;
+        return;
+    }
 
-        void *rightmost_node = get_page(table->pager, rightmost_child_page_num);
-        uint32_t rightmost_node_max_key = get_node_max_key(table->pager, rightmost_node);
+    Frame *frame = &(pager->frames[user_data]);
+    if(result < (int32_t)PAGE_SIZE){
+        pread_full(pager->file_descriptor, frame->data + result, PAGE_SIZE - result,
+                   (off_t)frame->page_num * PAGE_SIZE + result);
+    }
+    frame->io_pending = false;
+}
 
-        *(internal_node_num_keys(parent_node)) += 1;
+// Processes finished I/Os; with wait set, blocks until at least one has completed.
+void io_engine_reap(Pager *pager, bool wait){
+    IoEngine *engine = &(pager->io);
+    io_engine_submit(engine);
 
-        if(child_node_max_key > rightmost_node_max_key){
-            *(internal_node_child(parent_node, num_keys_in_parent)) = rightmost_child_page_num;
-            *(internal_node_key(parent_node, num_keys_in_parent)) = rightmost_node_max_key;
-            *(internal_node_right_child(parent_node)) = new_page_num;
-        }else{
-            for (int32_t idx = num_keys_in_parent; idx > child_node_index; idx--){
-                void* destination_cell = internal_node_cell(parent_node, idx);
-                void* source_cell = internal_node_cell(parent_node, idx - 1);
-                memcpy(destination_cell, source_cell, INTERNAL_NODE_CELL_SIZE);
+    uint32_t head = *(engine->cq_head);
+    if(wait && head == __atomic_load_n(engine->cq_tail, __ATOMIC_ACQUIRE) && engine->in_flight > 0){
+        while(syscall(__NR_io_uring_enter, engine->ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) == -1){
+            if(errno != EINTR){
+                printf("Error: waiting for asynchronous page I/O %d\n", errno);
+                exit(EXIT_FAILURE);
             }
-            *(internal_node_child(parent_node, child_node_index)) = new_page_num;
-            *(internal_node_key(parent_node, child_node_index)) = child_node_max_key;
         }
     }
+
+    while(head != __atomic_load_n(engine->cq_tail, __ATOMIC_ACQUIRE)){
+        struct io_uring_cqe *cqe = &(engine->cqes[head & *(engine->cq_ring_mask)]);
+        io_engine_complete(pager, cqe->user_data, cqe->res);
+        engine->in_flight--;
+        head++;
+    }
+    __atomic_store_n(engine->cq_head, head, __ATOMIC_RELEASE);
 }
 
-void internal_node_split_and_insert(Table* table, uint32_t parent_page_num, uint32_t child_page_num){
-    uint32_t old_page_num = parent_page_num;
-    void *old_node = get_page(table->pager, old_page_num);
-    uint32_t old_node_max_key = get_node_max_key(table->pager, old_node);
+void io_engine_drain(Pager *pager){
+    while(pager->io.enabled && (pager->io.in_flight > 0 || pager->io.unsubmitted > 0)){
+        io_engine_reap(pager, true);
+    }
+}
 
-    void *child_node = get_page(table->pager, child_page_num);
-    uint32_t child_node_max_key = get_node_max_key(table->pager, child_node);
+// Queues one read or write; completions are reaped first if the rings are full.
+void io_engine_queue(Pager *pager, uint8_t opcode, void *address, uint32_t length, off_t offset, uint64_t user_data){
+    IoEngine *engine = &(pager->io);
+    while(engine->in_flight + engine->unsubmitted >= engine->sq_entries){
+        io_engine_reap(pager, true);
+    }
 
-    uint32_t new_page_num = get_new_unused_page_num(table->pager);
+    uint32_t tail = *(engine->sq_tail);
+    uint32_t index = tail & *(engine->sq_ring_mask);
+    struct io_uring_sqe *sqe = &(engine->sqes[index]);
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = opcode;
+    sqe->fd = pager->file_descriptor;
+    sqe->addr = (uint64_t)(uintptr_t)address;
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    engine->sq_array[index] = index;
+    __atomic_store_n(engine->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    engine->unsubmitted++;
+}
 
-    // With this we are checking whether we are splitting the internal root node or not..
-    uint32_t splitting_root = is_node_root(old_node);
+int compare_frames_by_page_num(const void *a, const void *b){
+    uint32_t page_a = (*(Frame **)a)->page_num;
+    uint32_t page_b = (*(Frame **)b)->page_num;
+    return (page_a > page_b) - (page_a < page_b);
+}
 
-    void* parent;
-    void* new_node;
-    if(splitting_root){
-        create_new_root(table, new_page_num);
-        parent = get_page(table->pager, table->root_page_num);
-        old_page_num = *(internal_node_child(parent, 0));
-        old_node = get_page(table->pager, old_page_num);
+/*
+Writes every dirty frame back to the file. Dirty pages are sorted by page number, and
+runs of adjacent pages go out in a single pwritev call instead of one write per page.
+With io_uring every run is submitted up front, so the device sees them all at once.
+*/
+void pager_flush_dirty_pages(Pager *pager){
+    Frame **dirty_frames = (Frame **)malloc((pager->num_frames + pager->mapped_pages) * sizeof(Frame *));
+    uint32_t num_dirty = 0;
+    for (uint32_t i = 0; i < pager->num_frames; i++){
+        if(pager->frames[i].page_num != INVALID_PAGE_NUM && pager->frames[i].is_dirty){
+            dirty_frames[num_dirty++] = &(pager->frames[i]);
+        }
     }
-    else
-    {
-        parent = get_page(table->pager, *get_parent_node(old_node));
-        initialize_internal_node(new_node);
+    for (uint32_t i = 0; i < pager->mapped_pages; i++){
+        if(pager->map_frames[i].is_dirty){
+            dirty_frames[num_dirty++] = &(pager->map_frames[i]);
+        }
     }
-    new_node = get_page(table->pager, new_page_num);
-
-    uint32_t* old_num_keys = internal_node_num_keys(old_node);
-    // Get the rightmost child from left internal node, and store it's pageNum in new right
-    // internal node and set right child pageNum for left internal node as INVALID_PAGE_NUM
-    uint32_t old_node_right_child_page_num = *(internal_node_right_child(old_node));
-    void *old_node_right_child = get_page(table->pager, old_node_right_child_page_num);
+    qsort(dirty_frames, num_dirty, sizeof(Frame *), compare_frames_by_page_num);
+
+    struct iovec *iov = (struct iovec *)malloc(num_dirty * sizeof(struct iovec));
+    IoWrite *writes = (IoWrite *)malloc(num_dirty * sizeof(IoWrite));
+    uint32_t num_writes = 0;
+    pager->io.writes = writes;
+
+    uint32_t run_start = 0;
+    while(run_start < num_dirty){
+        uint32_t first_page_num = dirty_frames[run_start]->page_num;
+        uint32_t run_length = 0;
+        while(run_start + run_length < num_dirty && run_length < FLUSH_MAX_IOVECS &&
+              dirty_frames[run_start + run_length]->page_num == first_page_num + run_length){
+            iov[run_start + run_length].iov_base = dirty_frames[run_start + run_length]->data;
+            iov[run_start + run_length].iov_len = PAGE_SIZE;
+            run_length++;
+        }
 
-    int32_t node_right_child_page_num = *(internal_node_right_child(new_node));
-    internal_node_insert(table, new_page_num, old_node_right_child_page_num);
-    *(get_parent_node(old_node_right_child)) = new_page_num;
-    *(internal_node_right_child(old_node)) = INVALID_PAGE_NUM;
-    
-    /* For each key in old_node until the mid key, move the cell(left_child_page_num + key) to the new_page(right_node) */
-    for (int32_t i = (INTERNAL_NODE_MAX_CELLS - 1); i > (INTERNAL_NODE_MAX_CELLS) / 2; i--){
-        uint32_t old_node_child_page_num = *(internal_node_child(old_node, i));
-        internal_node_insert(table, new_page_num, old_node_child_page_num);
+        if(pager->io.enabled){
+            IoWrite *write = &(writes[num_writes]);
+            write->iov = &(iov[run_start]);
+            write->iov_count = run_length;
+            write->offset = (off_t)first_page_num * PAGE_SIZE;
+            write->length = (size_t)run_length * PAGE_SIZE;
+            io_engine_queue(pager, IORING_OP_WRITEV, write->iov, run_length, write->offset, IO_WRITE_TAG | num_writes);
+            pager->io.writes_pending++;
+            pager->io.writes_submitted++;
+            num_writes++;
+        }else{
+            pwritev_full(pager->file_descriptor, &(iov[run_start]), run_length, (off_t)first_page_num * PAGE_SIZE);
+        }
 
-        void *old_node_child_node = get_page(table->pager, old_node_child_page_num);
-        *(get_parent_node(old_node_child_node)) = new_page_num;
-        (*old_num_keys)--;
+        for (uint32_t i = 0; i < run_length; i++){
+            dirty_frames[run_start + i]->is_dirty = false;
+        }
+        if((off_t)(first_page_num + run_length) * PAGE_SIZE > pager->file_length){
+            pager->file_length = (off_t)(first_page_num + run_length) * PAGE_SIZE;
+        }
+        pager->pages_written += run_length;
+        run_start += run_length;
     }
 
-    // Set the rightmost child node page num for the old(left internal) node as old node's 
-    // mid cell's child page_num(bcz this cell will move up to the parent cell now).
-    *(internal_node_right_child(old_node)) = *(internal_node_child(old_node, *(old_num_keys) - 1));
-    (*old_num_keys)--;
-
-    /* Determine which of the two internal node's would contain the new child node to be 
-    added(passed in this function's parameter) and add that node in one of the internal node*/
-    uint32_t old_node_new_max_key = *(internal_node_max_key(old_node));
-    uint32_t destination_page_num = child_node_max_key < old_node_new_max_key ? old_page_num : new_page_num;
-    internal_node_insert(table, destination_page_num, child_page_num);
-    *(get_parent_node(child_node)) = destination_page_num;
-
-    update_internal_node_key(parent, old_node_max_key, old_node_new_max_key);
+    while(pager->io.writes_pending > 0){
+        io_engine_reap(pager, true);
+    }
+    pager->io.writes = NULL;
+    free(writes);
+    free(iov);
+    free(dirty_frames);
+}
 
-    if(!splitting_root){
-        internal_node_insert(table, *(get_parent_node(old_node)), new_page_num);
-        *(get_parent_node(new_node)) = *(get_parent_node(old_node));
+uint32_t fnv1a_hash(uint32_t hash, const void *data, size_t length){
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < length; i++){
+        hash ^= bytes[i];
+        hash *= 16777619u;
     }
+    return hash;
 }
 
-void leaf_node_split_and_insert(Cursor* cursor, uint32_t key, Row* row_data){
-    void *old_node = get_page(cursor->table->pager, cursor->page_num);
-    uint32_t old_node_max_key = *(leaf_node_max_key(old_node));
+uint32_t wal_record_checksum(WalRecordHeader *header, void *page){
+    uint32_t hash = fnv1a_hash(2166136261u, &(header->type), sizeof(header->type));
+    hash = fnv1a_hash(hash, &(header->page_num), sizeof(header->page_num));
+    if(page != NULL){
+        hash = fnv1a_hash(hash, page, PAGE_SIZE);
+    }
+    return hash;
+}
 
-    uint32_t new_page_num = get_new_unused_page_num(cursor->table->pager);
-    void *new_node = get_page(cursor->table->pager, new_page_num);
-    initialize_leaf_node(new_node);
-    *(get_parent_node(new_node)) = *(get_parent_node(old_node));
+void fill_wal_record_header(WalRecordHeader *header, WalRecordType type, uint32_t page_num, void *page){
+    header->magic = WAL_RECORD_MAGIC;
+    header->type = type;
+    header->page_num = page_num;
+    header->checksum = wal_record_checksum(header, page);
+}
 
-    *(leaf_next_leaf_node(new_node)) = *(leaf_next_leaf_node(old_node));
-    *(leaf_next_leaf_node(old_node)) = new_page_num;
+// Reads the record at offset into header/page, returning false for a torn or garbage record.
+bool read_wal_record(int fd, off_t offset, off_t wal_length, WalRecordHeader *header, void *page){
+    if(offset + (off_t)sizeof(WalRecordHeader) > wal_length){
+        return false;
+    }
+    if(pread_full(fd, header, sizeof(WalRecordHeader), offset) != sizeof(WalRecordHeader) ||
+       header->magic != WAL_RECORD_MAGIC){
+        return false;
+    }
 
-    /*
-    Now we'll evenly distribute the existing cells + new key-value pair
-    from old_node to new_node by iterating over all cells in existing old-node.
-    */
-    uint32_t num_cells_old_node = *(leaf_node_num_cells(old_node));
-    for (int32_t i = LEAF_NODE_MAX_CELLS; i >= 0; i--)
-    {
-        void *destination_node;
-        if(i >= LEAF_NODE_SPLIT_LEFT_NUM_CELLS){
-            destination_node = new_node;
-        }else{
-            destination_node = old_node;
+    if(header->type == WAL_PAGE_RECORD){
+        if(offset + (off_t)(sizeof(WalRecordHeader) + PAGE_SIZE) > wal_length ||
+           pread_full(fd, page, PAGE_SIZE, offset + sizeof(WalRecordHeader)) != PAGE_SIZE){
+            return false;
         }
+        return header->checksum == wal_record_checksum(header, page);
+    }
+    return header->type == WAL_COMMIT_RECORD && header->checksum == wal_record_checksum(header, NULL);
+}
 
-        uint32_t cell_insert_index = i % LEAF_NODE_SPLIT_LEFT_NUM_CELLS;
-        void *destination = leaf_node_cell(destination_node, cell_insert_index);
+/*
+Replays the WAL into the database file. Only page images followed by a commit record are
+applied; a statement that was cut off mid-append is dropped as if it never ran.
+*/
+void wal_recover(int db_fd, int wal_fd){
+    struct stat wal_stat;
+    if(fstat(wal_fd, &wal_stat) == -1){
+        printf("Error: reading write-ahead log size %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    off_t wal_length = wal_stat.st_size;
+    if(wal_length <= 0){
+        return;
+    }
 
-        if(cursor->cell_num == i){
-            serialize_row_data(row_data, leaf_node_value(destination_node, cell_insert_index));
-            *(leaf_node_key(destination_node, cell_insert_index)) = key;
-        }
-        else if (cursor->cell_num < i)
-        {
-            memcpy(destination, leaf_node_cell(old_node, i - 1), LEAF_NODE_CELL_SIZE);
-        }
-        else
-        {
-            memcpy(destination, leaf_node_cell(old_node, i), LEAF_NODE_CELL_SIZE);
+    WalRecordHeader header;
+    void *page = malloc(PAGE_SIZE);
+    off_t offset = 0, committed_length = 0;
+    while(read_wal_record(wal_fd, offset, wal_length, &header, page)){
+        offset += sizeof(WalRecordHeader) + (header.type == WAL_PAGE_RECORD ? PAGE_SIZE : 0);
+        if(header.type == WAL_COMMIT_RECORD){
+            committed_length = offset;
         }
     }
 
-    *(leaf_node_num_cells(old_node)) = LEAF_NODE_SPLIT_LEFT_NUM_CELLS;
-    *(leaf_node_num_cells(new_node)) = LEAF_NODE_SPLIT_RIGHT_NUM_CELLS;
+    uint32_t recovered_pages = 0;
+    offset = 0;
+    while(offset < committed_length && read_wal_record(wal_fd, offset, wal_length, &header, page)){
+        offset += sizeof(WalRecordHeader);
+        if(header.type == WAL_PAGE_RECORD){
+            pwrite_full(db_fd, page, PAGE_SIZE, (off_t)header.page_num * PAGE_SIZE);
+            offset += PAGE_SIZE;
+            recovered_pages++;
+        }
+    }
+    free(page);
 
-    // Update the parent node for these 2 split nodes..
-    if(is_node_root(old_node)){
-        return create_new_root(cursor->table, new_page_num);
-    }else{
-        // This is an internal node, so need to add code changes to update this as well..
-        uint32_t old_node_new_max_key = *(leaf_node_max_key(old_node));
-        uint32_t parent_page_num = *(get_parent_node(old_node));
-        void *parent_node = get_page(cursor->table->pager, parent_page_num);
-        update_internal_node_key(parent_node, old_node_max_key, old_node_new_max_key);
-        internal_node_insert(cursor->table, parent_page_num, new_page_num);
+    if(fsync(db_fd) == -1 || ftruncate(wal_fd, 0) == -1 || fsync(wal_fd) == -1){
+        printf("Error: finishing write-ahead log recovery %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    if(recovered_pages > 0){
+        printf("Recovered %d page images from write-ahead log\n", recovered_pages);
     }
 }
 
-void leaf_node_insert(Cursor *cursor, uint32_t key, Row* row_data){
-    void *node = get_page(cursor->table->pager, cursor->page_num);
-    uint32_t num_cells_page = *leaf_node_num_cells(node);
+uint64_t monotonic_time_us(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
 
-    if(num_cells_page >= LEAF_NODE_MAX_CELLS){
-        leaf_node_split_and_insert(cursor, key, row_data);
+// Makes every appended commit durable with a single fdatasync.
+void wal_sync(Wal *wal){
+    if(wal->durable_commit == wal->commits){
         return;
     }
-
-    if((cursor->cell_num) < num_cells_page){
-        for (uint32_t i = num_cells_page; i > (cursor->cell_num); i--){
-            memcpy(leaf_node_cell(node, i), leaf_node_cell(node, i - 1), LEAF_NODE_CELL_SIZE);
-        }
+    if(fdatasync(wal->file_descriptor) == -1){
+        printf("Error: syncing write-ahead log %d\n", errno);
+        exit(EXIT_FAILURE);
     }
+    wal->durable_commit = wal->commits;
+    wal->syncs++;
+}
 
-    *(leaf_node_num_cells(node)) += 1;
-    *(leaf_node_key(node, cursor->cell_num)) = key;
-    serialize_row_data(row_data, leaf_node_value(node, cursor->cell_num));
+bool wal_commit_is_durable(Wal *wal, uint64_t commit_num){
+    return commit_num <= wal->durable_commit;
 }
 
-Pager* initialize_pager(char const* filename){
-    int fd = open(filename, O_RDWR | O_CREAT, S_IWUSR | S_IRUSR);
+// Milliseconds until the pending group must be synced, or -1 when nothing is pending.
+int wal_sync_deadline_ms(Wal *wal){
+    if(wal->durable_commit == wal->commits){
+        return -1;
+    }
+    uint64_t waited_us = monotonic_time_us() - wal->oldest_pending_us;
+    uint64_t max_delay_us = (uint64_t)wal->max_delay_ms * 1000;
+    return waited_us >= max_delay_us ? 0 : (int)((max_delay_us - waited_us + 999) / 1000);
+}
 
-    if(fd == -1){
-        printf("Error: Unable to open file \n");
+void wal_open(Wal *wal, const char *db_filename, int db_fd, uint32_t max_batch, uint32_t max_delay_ms){
+    wal->filename = malloc(strlen(db_filename) + 5);
+    sprintf(wal->filename, "%s-wal", db_filename);
+
+    wal->file_descriptor = open(wal->filename, O_RDWR | O_CREAT, S_IWUSR | S_IRUSR);
+    if(wal->file_descriptor == -1){
+        printf("Error: Unable to open write-ahead log %s\n", wal->filename);
         exit(EXIT_FAILURE);
     }
+    wal->file_length = 0;
+    wal->num_logged_pages = 0;
+    wal->commits = 0;
+    wal->durable_commit = 0;
+    wal->checkpoints = 0;
+    wal->syncs = 0;
+    wal->max_batch = max_batch == 0 ? 1 : max_batch;
+    wal->max_delay_ms = max_delay_ms;
+    wal->oldest_pending_us = 0;
+
+    wal_recover(db_fd, wal->file_descriptor);
+}
 
-    off_t file_length = lseek(fd, 0, SEEK_END);
+/*
+Maps the whole file (up to the reserved size) over the reserved address range. The
+mapping is MAP_PRIVATE, so page modifications stay in copy-on-write memory and reach the
+file only through the WAL and the flush paths, never behind the log's back. Mapping
+again after a checkpoint drops those private copies and covers pages the file grew by.
+Only called between statements, when every page is clean and no pointers are held.
+*/
+void pager_map_file(Pager *pager){
+    uint32_t file_pages = pager->file_length / PAGE_SIZE;
+    uint32_t max_pages = pager->map_reserved_bytes / PAGE_SIZE;
+    uint32_t num_pages_to_map = file_pages < max_pages ? file_pages : max_pages;
+    if(num_pages_to_map == 0){
+        return;
+    }
 
-    Pager *pager = (Pager *)malloc(sizeof(Pager));
+    void *mapping = mmap(pager->map_base, (size_t)num_pages_to_map * PAGE_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_FIXED, pager->file_descriptor, 0);
+    if(mapping == MAP_FAILED){
+        printf("Error: mapping database file %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
 
-    pager->file_length = file_length;
-    pager->file_descriptor = fd;
-    pager->num_pages = file_length / PAGE_SIZE;
+    pager->map_frames = realloc(pager->map_frames, num_pages_to_map * sizeof(Frame));
+    for (uint32_t page_num = pager->mapped_pages; page_num < num_pages_to_map; page_num++){
+        // Pages that move from the pool into the mapping are clean after a checkpoint.
+        if(page_num < pager->page_table_size && pager->page_table[page_num] != INVALID_FRAME_NUM){
+            pager->frames[pager->page_table[page_num]].page_num = INVALID_PAGE_NUM;
+            pager->page_table[page_num] = INVALID_FRAME_NUM;
+        }
 
-    if (file_length % PAGE_SIZE != 0) {
-     printf("Db file is not a whole number of pages. Corrupt file.\n");
-     exit(EXIT_FAILURE);
+        Frame *frame = &(pager->map_frames[page_num]);
+        frame->data = pager->map_base + (size_t)page_num * PAGE_SIZE;
+        frame->page_num = page_num;
+        frame->reference_bit = false;
+        frame->is_dirty = false;
+        frame->in_txn = false;
+        frame->commit_num = 0;
+        frame->io_pending = false;
+        frame->pin_epoch = 0;
     }
+    pager->mapped_pages = num_pages_to_map;
+}
 
+// Tells the kernel a full scan is running over the mapping so it reads ahead aggressively.
+void pager_advise_sequential_scan(Pager *pager, bool sequential){
+    if(pager->mapped_pages > 0){
+        madvise(pager->map_base, (size_t)pager->mapped_pages * PAGE_SIZE, sequential ? MADV_SEQUENTIAL : MADV_NORMAL);
+    }
+}
 
-    for (uint32_t i = 0; i < MAX_TABLE_PAGES; i++){
-        pager->pages[i] = NULL;
+/*
+Copies every page changed since the previous checkpoint into the database file, makes it
+durable and empties the WAL. Only called between statements.
+*/
+void pager_checkpoint(Pager *pager){
+    // Read-ahead must land before frames can be handed over to the mapping.
+    io_engine_drain(pager);
+    wal_sync(&(pager->wal));
+    pager_flush_dirty_pages(pager);
+    if(fsync(pager->file_descriptor) == -1){
+        printf("Error: syncing database file during checkpoint %d\n", errno);
+        exit(EXIT_FAILURE);
     }
+    if(ftruncate(pager->wal.file_descriptor, 0) == -1 || fsync(pager->wal.file_descriptor) == -1){
+        printf("Error: resetting write-ahead log during checkpoint %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    pager->wal.file_length = 0;
+    pager->wal.num_logged_pages = 0;
+    pager->wal.checkpoints++;
 
-    return pager;
+    if(pager->use_mmap){
+        pager_map_file(pager);
+    }
 }
 
-Cursor* leaf_node_find(Table* table, uint32_t page_num, uint32_t key_to_insert){
-    void *node = get_page(table->pager, page_num);
-    uint32_t num_cells = *leaf_node_num_cells(node);
-
-    Cursor *cursor = (Cursor *)malloc(sizeof(Cursor));
-    cursor->table = table;
-    cursor->page_num = page_num;
+/*
+Commits the running statement: the images of the pages it modified and a commit record
+are appended to the WAL with one write. The fdatasync that makes it durable is shared
+with the rest of its group; returns the commit number, or 0 when nothing changed.
+*/
+uint64_t pager_commit(Pager *pager){
+    if(pager->txn_num_pages == 0){
+        return 0;
+    }
+    uint64_t commit_num = pager->wal.commits + 1;
+
+    const size_t record_size = sizeof(WalRecordHeader) + PAGE_SIZE;
+    size_t buffer_size = pager->txn_num_pages * record_size + sizeof(WalRecordHeader);
+    char *buffer = malloc(buffer_size);
+    char *position = buffer;
+
+    for (uint32_t i = 0; i < pager->txn_num_pages; i++){
+        uint32_t page_num = pager->txn_pages[i];
+        Frame *frame = lookup_frame(pager, page_num);
+
+        fill_wal_record_header((WalRecordHeader *)position, WAL_PAGE_RECORD, page_num, frame->data);
+        memcpy(position + sizeof(WalRecordHeader), frame->data, PAGE_SIZE);
+        position += record_size;
+        frame->in_txn = false;
+        frame->commit_num = commit_num;
+    }
+    fill_wal_record_header((WalRecordHeader *)position, WAL_COMMIT_RECORD, pager->num_pages, NULL);
 
-    uint32_t lower_cell_index = 0;
-    uint32_t upper_cell_index = num_cells;
+    Wal *wal = &(pager->wal);
+    pwrite_full(wal->file_descriptor, buffer, buffer_size, wal->file_length);
+    wal->file_length += buffer_size;
+    free(buffer);
 
-    // Implement Binary Search to get required key index...
-    while(lower_cell_index != upper_cell_index){
-        uint32_t mid_cell_index = (lower_cell_index + upper_cell_index) / 2;
+    if(wal->durable_commit == wal->commits){
+        wal->oldest_pending_us = monotonic_time_us();
+    }
+    wal->num_logged_pages += pager->txn_num_pages;
+    wal->commits = commit_num;
+    pager->txn_num_pages = 0;
 
-        uint32_t key_in_table = *leaf_node_key(node, mid_cell_index);
+    if(wal->commits - wal->durable_commit >= wal->max_batch || wal_sync_deadline_ms(wal) == 0){
+        wal_sync(wal);
+    }
+    if(wal->num_logged_pages >= WAL_CHECKPOINT_PAGES){
+        pager_checkpoint(pager);
+    }
+    return commit_num;
+}
 
-        // Condition when key already exists in table..
-        if (key_in_table == key_to_insert)
-        {
-            cursor->cell_num = mid_cell_index;
-            return cursor;
-        }
+void grow_page_table(Pager *pager, uint32_t page_num){
+    uint32_t new_size = pager->page_table_size == 0 ? 64 : pager->page_table_size;
+    while(new_size <= page_num){
+        new_size *= 2;
+    }
 
-        if(key_in_table > key_to_insert){
-            upper_cell_index = mid_cell_index;
-        }else{
-            lower_cell_index = mid_cell_index + 1;
-        }
+    uint32_t *page_table = realloc(pager->page_table, new_size * sizeof(uint32_t));
+    if(page_table == NULL){
+        printf("Error: Unable to grow buffer pool page table\n");
+        exit(EXIT_FAILURE);
     }
 
-    cursor->cell_num = lower_cell_index;
-    return cursor;
+    for (uint32_t i = pager->page_table_size; i < new_size; i++){
+        page_table[i] = INVALID_FRAME_NUM;
+    }
+    pager->page_table = page_table;
+    pager->page_table_size = new_size;
 }
 
-Cursor* internal_node_find(Table* table, uint32_t page_num, uint32_t key){
-    void *internal_node = get_page(table->pager, page_num);
-    uint32_t num_keys_node = *(internal_node_num_keys(internal_node));
-
-    uint32_t min_key_id = internal_node_find_child(internal_node, key);
-    uint32_t max_key_in_node = *(internal_node_key(internal_node, num_keys_node - 1));
-    uint32_t child_page_num;
-    if (key > max_key_in_node)
+/*
+CLOCK replacement: sweep the frames, giving every recently referenced frame a second
+chance by clearing its reference bit. Frames pinned by the running statement are
+skipped, since callers may still hold pointers into them.
+*/
+uint32_t find_victim_frame(Pager *pager){
+    for (uint32_t step = 0; step < 2 * pager->num_frames; step++){
+        uint32_t frame_num = pager->clock_hand;
+        Frame *frame = &(pager->frames[frame_num]);
+        pager->clock_hand = (pager->clock_hand + 1) % pager->num_frames;
+
+        if(frame->page_num == INVALID_PAGE_NUM){
+            return frame_num;
+        }
+        if(frame->pin_epoch == pager->epoch || frame->in_txn || frame->io_pending){
+            continue;
+        }
+        if(frame->reference_bit){
+            frame->reference_bit = false;
+            continue;
+        }
+        return frame_num;
+    }
+    return INVALID_FRAME_NUM;
+}
+
+// Frees a frame for a new page, returning INVALID_FRAME_NUM when every frame is in use.
+uint32_t evict_frame(Pager *pager){
+    uint32_t frame_num = find_victim_frame(pager);
+    if(frame_num == INVALID_FRAME_NUM){
+        return INVALID_FRAME_NUM;
+    }
+    Frame *frame = &(pager->frames[frame_num]);
+
+    if(frame->page_num != INVALID_PAGE_NUM){
+        if(frame->is_dirty){
+            // The log record for this image must reach disk before the image itself does.
+            if(!wal_commit_is_durable(&(pager->wal), frame->commit_num)){
+                wal_sync(&(pager->wal));
+            }
+            write_page_to_disk(pager, frame->page_num, frame->data);
+            frame->is_dirty = false;
+        }
+        pager->page_table[frame->page_num] = INVALID_FRAME_NUM;
+        frame->page_num = INVALID_PAGE_NUM;
+        pager->evictions++;
+    }
+
+    if(frame->data == NULL){
+        frame->data = malloc(PAGE_SIZE);
+    }
+    return frame_num;
+}
+
+// Unpins every frame fetched so far. Must only be called when no page pointers are held.
+void pager_release_pins(Pager *pager){
+    pager->epoch++;
+}
+
+/*
+Statements that touch an unbounded number of pages (bulk loads, range deletes) commit in steps,
+because uncommitted pages can't be evicted and would otherwise fill the pool.
+*/
+void pager_commit_if_large(Pager *pager){
+    if(pager->txn_num_pages >= pager->num_frames / 4){
+        pager_release_pins(pager);
+        pager_commit(pager);
+    }
+}
+
+void *get_page(Pager *pager, uint32_t page_num){
+    if(page_num == INVALID_PAGE_NUM){
+        printf("Error: page_num out of bound %d\n", page_num);
+        exit(EXIT_FAILURE);
+    }
+
+    if(page_num < pager->mapped_pages){
+        pager->map_hits++;
+        return pager->map_frames[page_num].data;
+    }
+
+    if(page_num >= pager->page_table_size){
+        grow_page_table(pager, page_num);
+    }
+
+    uint32_t frame_num = pager->page_table[page_num];
+    if(frame_num != INVALID_FRAME_NUM){
+        pager->hits++;
+        // Prefetched page whose read hasn't landed yet.
+        while(pager->frames[frame_num].io_pending){
+            io_engine_reap(pager, true);
+        }
+    }else{
+        pager->misses++;
+        frame_num = evict_frame(pager);
+        if(frame_num == INVALID_FRAME_NUM){
+            printf("Error: buffer pool exhausted, all %d frames are pinned or uncommitted\n", pager->num_frames);
+            exit(EXIT_FAILURE);
+        }
+        void *page = pager->frames[frame_num].data;
+        memset(page, 0, PAGE_SIZE);
+
+        uint32_t num_pages_file = pager->file_length / PAGE_SIZE;
+
+        // If we have partial filled page stored in file, add that as well.
+        if((pager->file_length) % PAGE_SIZE > 0){
+            num_pages_file++;
+        }
+
+        // A short read at the end of the file leaves the rest of the page zeroed.
+        if(page_num <= num_pages_file){
+            pread_full(pager->file_descriptor, page, PAGE_SIZE, (off_t)page_num * PAGE_SIZE);
+        }
+        pager->frames[frame_num].page_num = page_num;
+        pager->page_table[page_num] = frame_num;
+
+        if(page_num >= pager->num_pages){
+            pager->num_pages = page_num + 1;
+        }
+    }
+
+    Frame *frame = &(pager->frames[frame_num]);
+    frame->reference_bit = true;
+    frame->pin_epoch = pager->epoch;
+    return frame->data;
+}
+
+/*
+Starts reading the given pages into free frames without waiting for them, so many reads
+are in flight at once; get_page only blocks if it needs a page before its read lands.
+Without io_uring the kernel is asked to read the pages into its cache instead.
+*/
+void pager_prefetch_pages(Pager *pager, const uint32_t *page_nums, uint32_t count){
+    uint32_t file_pages = pager->file_length / PAGE_SIZE;
+    for (uint32_t i = 0; i < count; i++){
+        uint32_t page_num = page_nums[i];
+        // Pages past num_pages are unallocated and may still be written behind the pool's back.
+        if(page_num >= file_pages || page_num >= pager->num_pages){
+            continue;
+        }
+        if(page_num < pager->mapped_pages){
+            madvise(pager->map_frames[page_num].data, PAGE_SIZE, MADV_WILLNEED);
+            pager->prefetches++;
+            continue;
+        }
+        if(page_num < pager->page_table_size && pager->page_table[page_num] != INVALID_FRAME_NUM){
+            continue;
+        }
+        if(!pager->io.enabled){
+            // Adjacent pages are merged into one hint.
+            uint32_t run_length = 1;
+            while(i + run_length < count && page_nums[i + run_length] == page_num + run_length &&
+                  page_num + run_length < file_pages){
+                run_length++;
+            }
+            posix_fadvise(pager->file_descriptor, (off_t)page_num * PAGE_SIZE, (off_t)run_length * PAGE_SIZE, POSIX_FADV_WILLNEED);
+            pager->prefetches += run_length;
+            i += run_length - 1;
+            continue;
+        }
+
+        // Read-ahead is only a hint, so stop quietly once the pool has no frame to spare.
+        uint32_t frame_num = evict_frame(pager);
+        if(frame_num == INVALID_FRAME_NUM){
+            break;
+        }
+        if(page_num >= pager->page_table_size){
+            grow_page_table(pager, page_num);
+        }
+
+        Frame *frame = &(pager->frames[frame_num]);
+        memset(frame->data, 0, PAGE_SIZE);
+        frame->page_num = page_num;
+        frame->reference_bit = true;
+        frame->io_pending = true;
+        pager->page_table[page_num] = frame_num;
+        io_engine_queue(pager, IORING_OP_READ, frame->data, PAGE_SIZE, (off_t)page_num * PAGE_SIZE, frame_num);
+        pager->io.reads_submitted++;
+        pager->prefetches++;
+    }
+
+    if(pager->io.enabled){
+        io_engine_submit(&(pager->io));
+    }
+}
+
+// Validates the fields of an inserted row and copies them into row.
+PrepareResult prepare_row(char* id_string, char* username, char* email, Row* row){
+    if(id_string == NULL || username == NULL || email == NULL){
+        return PREPARE_SYNTAX_ERROR;
+    }
+
+    int id = atoi(id_string);
+    if (id < 0)
     {
-        // That means it's should point to the right most child node 
-        // whose page num is stored in internal node header..
-        child_page_num = *(internal_node_right_child(internal_node));
+        return PREPARE_INVALID_ID;
+    }
+
+    if(strlen(username) > MAX_USERNAME_CHAR){
+        return PREPARE_USERNAME_TOO_LONG;
+    }
+    if(strlen(email) > MAX_EMAIL_CHAR){
+        return PREPARE_EMAIL_TOO_LONG;
+    }
+
+    row->id = id;
+    strcpy(row->username, username);
+    strcpy(row->email, email);
+
+    return PREPARE_SUCCESS;
+}
+
+uint32_t row_payload_size(Row* row_data){
+    return 2 * ROW_FIELD_LENGTH_SIZE + strlen(row_data->username) + strlen(row_data->email);
+}
+
+// Writes one length-prefixed field and returns the position just past it.
+void* serialize_field(void* destination, const char* field){
+    uint16_t length = strlen(field);
+    memcpy(destination, &length, ROW_FIELD_LENGTH_SIZE);
+    memcpy(destination + ROW_FIELD_LENGTH_SIZE, field, length);
+    return destination + ROW_FIELD_LENGTH_SIZE + length;
+}
+
+void* deserialize_field(char* field, void* source){
+    uint16_t length;
+    memcpy(&length, source, ROW_FIELD_LENGTH_SIZE);
+    memcpy(field, source + ROW_FIELD_LENGTH_SIZE, length);
+    field[length] = '\0';
+    return source + ROW_FIELD_LENGTH_SIZE + length;
+}
+
+// The id is not part of the payload; it lives in the leaf's key array.
+void serialize_row_data(Row* row_data, void* row_slot){
+    void *position = serialize_field(row_slot, row_data->username);
+    serialize_field(position, row_data->email);
+}
+
+void deserialize_row_data(Row* destination,void* source){
+    void *position = deserialize_field(destination->username, source);
+    deserialize_field(destination->email, position);
+}
+
+// Bytes a payload of payload_size takes in its leaf: all of it, or the spilled prefix and pointer.
+uint32_t local_payload_size(uint32_t payload_size){
+    return payload_size <= LEAF_NODE_MAX_LOCAL ? payload_size : LEAF_NODE_MAX_LOCAL;
+}
+
+uint32_t overflow_pages_needed(uint32_t payload_size){
+    if(payload_size <= LEAF_NODE_MAX_LOCAL){
+        return 0;
+    }
+    return (payload_size - LEAF_NODE_SPILL_LOCAL_BYTES + OVERFLOW_PAGE_DATA_SIZE - 1) / OVERFLOW_PAGE_DATA_SIZE;
+}
+
+// Full size of a stored payload, read back from its length prefixes (which are always local).
+uint32_t stored_payload_size(void* payload){
+    uint16_t username_length, email_length;
+    memcpy(&username_length, payload, ROW_FIELD_LENGTH_SIZE);
+    memcpy(&email_length, payload + ROW_FIELD_LENGTH_SIZE + username_length, ROW_FIELD_LENGTH_SIZE);
+    return 2 * ROW_FIELD_LENGTH_SIZE + username_length + email_length;
+}
+
+// Bytes a stored payload takes in its leaf.
+uint32_t payload_size(void* payload){
+    return local_payload_size(stored_payload_size(payload));
+}
+
+uint32_t payload_overflow_page(void* payload){
+    uint32_t page_num;
+    memcpy(&page_num, payload + LEAF_NODE_SPILL_LOCAL_BYTES, LEAF_NODE_OVERFLOW_POINTER_SIZE);
+    return page_num;
+}
+
+
+/*
+Allocates a page for a new node. Free pages are reused first: the last page listed in
+the head trunk, or the trunk itself once it lists none. Only when the freelist is
+empty does the file grow. The page is reserved right away, so back-to-back calls
+never hand out the same page twice.
+*/
+uint32_t get_new_unused_page_num(Pager* pager){
+    void *header = get_page(pager, DB_HEADER_PAGE_NUM);
+    mark_page_dirty(pager, DB_HEADER_PAGE_NUM);
+    uint32_t trunk_page_num = *(db_header_freelist_head(header));
+    if(trunk_page_num == 0){
+        *(db_header_page_count(header)) = pager->num_pages + 1;
+        return pager->num_pages++;
+    }
+
+    (*(db_header_free_page_count(header)))--;
+
+    void *trunk = get_page(pager, trunk_page_num);
+    uint32_t *num_leaves = freelist_trunk_num_leaves(trunk);
+    if(*num_leaves > 0){
+        mark_page_dirty(pager, trunk_page_num);
+        (*num_leaves)--;
+        return *(freelist_trunk_leaf(trunk, *num_leaves));
+    }
+
+    *(db_header_freelist_head(header)) = *(freelist_trunk_next(trunk));
+    return trunk_page_num;
+}
+
+/*
+Returns a page that no node references anymore to the freelist. It's listed in the
+head trunk when that has room, otherwise the page itself becomes the new head trunk.
+*/
+void free_page(Pager* pager, uint32_t page_num){
+    void *header = get_page(pager, DB_HEADER_PAGE_NUM);
+    mark_page_dirty(pager, DB_HEADER_PAGE_NUM);
+    (*(db_header_free_page_count(header)))++;
+
+    uint32_t trunk_page_num = *(db_header_freelist_head(header));
+    if(trunk_page_num != 0){
+        void *trunk = get_page(pager, trunk_page_num);
+        uint32_t *num_leaves = freelist_trunk_num_leaves(trunk);
+        if(*num_leaves < FREELIST_TRUNK_MAX_LEAVES){
+            mark_page_dirty(pager, trunk_page_num);
+            *(freelist_trunk_leaf(trunk, *num_leaves)) = page_num;
+            (*num_leaves)++;
+            return;
+        }
+    }
+
+    void *new_trunk = get_page(pager, page_num);
+    mark_page_dirty(pager, page_num);
+    memset(new_trunk, 0, PAGE_SIZE);
+    *(freelist_trunk_next(new_trunk)) = trunk_page_num;
+    *(freelist_trunk_num_leaves(new_trunk)) = 0;
+    *(db_header_freelist_head(header)) = page_num;
+}
+
+// Writes length bytes into a chain of newly allocated overflow pages and returns its first page.
+uint32_t overflow_write_chain(Pager* pager, void* data, uint32_t length){
+    uint32_t first_page_num = 0;
+    void *previous_page = NULL;
+    for (uint32_t written = 0; written < length; written += OVERFLOW_PAGE_DATA_SIZE){
+        uint32_t page_num = get_new_unused_page_num(pager);
+        void *page = get_page(pager, page_num);
+        mark_page_dirty(pager, page_num);
+        uint32_t chunk = length - written < OVERFLOW_PAGE_DATA_SIZE ? length - written : OVERFLOW_PAGE_DATA_SIZE;
+        memcpy(page + OVERFLOW_PAGE_DATA_OFFSET, data + written, chunk);
+        *(overflow_next_page(page)) = 0;
+        if(previous_page == NULL){
+            first_page_num = page_num;
+        }else{
+            *(overflow_next_page(previous_page)) = page_num;
+        }
+        previous_page = page;
+    }
+    return first_page_num;
+}
+
+void overflow_free_chain(Pager* pager, uint32_t page_num){
+    while(page_num != 0){
+        uint32_t next_page_num = *(overflow_next_page(get_page(pager, page_num)));
+        free_page(pager, page_num);
+        page_num = next_page_num;
+    }
+}
+
+/*
+Stores row as a leaf value of local_payload_size(row_payload_size(row)) bytes at destination.
+A long row is serialized whole first; its tail goes to a new overflow chain.
+*/
+void store_row(Pager* pager, Row* row_data, void* destination){
+    uint32_t size = row_payload_size(row_data);
+    if(size <= LEAF_NODE_MAX_LOCAL){
+        serialize_row_data(row_data, destination);
+        return;
+    }
+
+    void *payload = malloc(size);
+    serialize_row_data(row_data, payload);
+    uint32_t first_page_num = overflow_write_chain(pager, payload + LEAF_NODE_SPILL_LOCAL_BYTES, size - LEAF_NODE_SPILL_LOCAL_BYTES);
+    memcpy(destination, payload, LEAF_NODE_SPILL_LOCAL_BYTES);
+    memcpy(destination + LEAF_NODE_SPILL_LOCAL_BYTES, &first_page_num, LEAF_NODE_OVERFLOW_POINTER_SIZE);
+    free(payload);
+}
+
+/*
+Reads a stored row back. The username is always local; the email's overflow chain is only
+followed when with_email is set, so scans that skip the email never read overflow pages.
+*/
+void load_row(Pager* pager, void* value, Row* row, bool with_email){
+    void *position = deserialize_field(row->username, value);
+    row->email[0] = '\0';
+    if(!with_email){
+        return;
+    }
+    uint32_t size = stored_payload_size(value);
+    if(size <= LEAF_NODE_MAX_LOCAL){
+        deserialize_field(row->email, position);
+        return;
+    }
+
+    uint16_t email_length;
+    memcpy(&email_length, position, ROW_FIELD_LENGTH_SIZE);
+    uint32_t copied = LEAF_NODE_SPILL_LOCAL_BYTES - (position - value) - ROW_FIELD_LENGTH_SIZE;
+    memcpy(row->email, position + ROW_FIELD_LENGTH_SIZE, copied);
+    uint32_t page_num = payload_overflow_page(value);
+    while(copied < email_length){
+        void *page = get_page(pager, page_num);
+        uint32_t chunk = email_length - copied < OVERFLOW_PAGE_DATA_SIZE ? email_length - copied : OVERFLOW_PAGE_DATA_SIZE;
+        memcpy(row->email + copied, page + OVERFLOW_PAGE_DATA_OFFSET, chunk);
+        copied += chunk;
+        page_num = *(overflow_next_page(page));
+    }
+    row->email[email_length] = '\0';
+}
+
+// Frees the overflow chain of a leaf cell, if it has one, before the cell is dropped or rewritten.
+void leaf_node_free_overflow(Pager* pager, void* node, uint32_t cell_num){
+    void *value = leaf_node_value(node, cell_num);
+    if(stored_payload_size(value) > LEAF_NODE_MAX_LOCAL){
+        overflow_free_chain(pager, payload_overflow_page(value));
+    }
+}
+
+// The root page and row count live in the header; Table caches them after open_db.
+void table_set_root_page_num(Table* table, uint32_t root_page_num){
+    void *header = get_page(table->pager, DB_HEADER_PAGE_NUM);
+    mark_page_dirty(table->pager, DB_HEADER_PAGE_NUM);
+    *(db_header_root_page(header)) = root_page_num;
+    table->root_page_num = root_page_num;
+}
+
+void table_add_rows(Table* table, int32_t delta){
+    void *header = get_page(table->pager, DB_HEADER_PAGE_NUM);
+    mark_page_dirty(table->pager, DB_HEADER_PAGE_NUM);
+    *(db_header_row_count(header)) += delta;
+    table->rows_count += delta;
+}
+
+/*
+Grows the tree by one level. The old root stays where it is and becomes the left child
+of a freshly allocated root page, so none of its children have to be touched; only
+the header's root pointer moves. The caller passes the old root's new max key.
+*/
+void create_new_root(Table* table, uint32_t left_child_max_key, uint32_t right_child_page_num){
+    uint32_t left_child_page_num = table->root_page_num;
+    uint32_t new_root_page_num = get_new_unused_page_num(table->pager);
+    void *left_node = get_page(table->pager, left_child_page_num);
+    void *root_node = get_page(table->pager, new_root_page_num);
+    mark_page_dirty(table->pager, left_child_page_num);
+    mark_page_dirty(table->pager, new_root_page_num);
+
+    set_is_root(left_node, false);
+
+    /* Root node is new internal node with 1 Key and 2 children pointers */
+    initialize_internal_node(root_node);
+    set_is_root(root_node, true);
+    *(internal_node_num_keys(root_node)) = 1;
+    *(internal_node_right_child(root_node)) = right_child_page_num;
+    *(internal_node_child(root_node, 0)) = left_child_page_num;
+    *(internal_node_key(root_node, 0)) = left_child_max_key;
+    table_set_root_page_num(table, new_root_page_num);
+}
+
+/*
+Key search kernels: count how many of num_keys (at most KEY_SEARCH_WINDOW) contiguous keys are
+below key. SSE2/AVX2 only have signed 32-bit compares, so both sides are biased by 2^31 first.
+*/
+typedef uint32_t (*KeyCountFn)(const uint32_t* keys, uint32_t num_keys, uint32_t key);
+
+uint32_t key_count_below_scalar(const uint32_t* keys, uint32_t num_keys, uint32_t key){
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < num_keys; i++){
+        count += keys[i] < key;
+    }
+    return count;
+}
+
+#if defined(__x86_64__)
+uint32_t key_count_below_sse2(const uint32_t* keys, uint32_t num_keys, uint32_t key){
+    const __m128i bias = _mm_set1_epi32((int)0x80000000u);
+    const __m128i target = _mm_xor_si128(_mm_set1_epi32((int)key), bias);
+    uint32_t count = 0, i = 0;
+    for (; i + 4 <= num_keys; i += 4){
+        __m128i block = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(keys + i)), bias);
+        count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(target, block))));
+    }
+    return count + key_count_below_scalar(keys + i, num_keys - i, key);
+}
+
+__attribute__((target("avx2")))
+uint32_t key_count_below_avx2(const uint32_t* keys, uint32_t num_keys, uint32_t key){
+    const __m256i bias = _mm256_set1_epi32((int)0x80000000u);
+    const __m256i target = _mm256_xor_si256(_mm256_set1_epi32((int)key), bias);
+    uint32_t count = 0, i = 0;
+    for (; i + 8 <= num_keys; i += 8){
+        __m256i block = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(keys + i)), bias);
+        count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(target, block))));
+    }
+    return count + key_count_below_sse2(keys + i, num_keys - i, key);
+}
+#endif
+
+KeyCountFn key_count_below = key_count_below_scalar;
+const char* key_search_kernel = "scalar";
+
+// Picks the widest kernel this CPU supports; called once at startup.
+void select_key_search_kernel(){
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+        key_count_below = key_count_below_avx2;
+        key_search_kernel = "avx2";
     }else{
-        child_page_num = *(internal_node_child(internal_node, min_key_id));
+        key_count_below = key_count_below_sse2;
+        key_search_kernel = "sse2";
+    }
+#endif
+}
+
+/*
+Index of the first of num_keys sorted keys that is >= key (num_keys if none is). Branch-free
+bisection halves the range until it fits the window, then the kernel counts the keys below.
+*/
+uint32_t key_search(const uint32_t* keys, uint32_t num_keys, uint32_t key){
+    uint32_t base = 0;
+    while(num_keys > KEY_SEARCH_WINDOW){
+        uint32_t half = num_keys / 2;
+        base = keys[base + half - 1] < key ? base + half : base;
+        num_keys -= half;
+    }
+    return base + key_count_below(keys + base, num_keys, key);
+}
+
+uint32_t internal_node_find_child(void* internal_node,uint32_t key){
+    uint32_t num_keys_node = *(internal_node_num_keys(internal_node));
+    return key_search(internal_node_key(internal_node, 0), num_keys_node, key);
+}
+
+/*
+Adds new_child_page_num to the internal node at path[level] of the cursor, right after the child
+the cursor descended through, which has just split its upper half off into it. Every key in an
+internal node bounds its child from above (it is the child's max key unless that was deleted),
+so the left child's entry takes the max key it was left with and the new child inherits the
+entry (and key) the left child had; no subtree has to be walked to find a key.
+*/
+void internal_node_insert(Cursor* cursor, uint32_t level, uint32_t left_child_max_key, uint32_t new_child_page_num){
+    Table *table = cursor->table;
+    uint32_t parent_page_num = cursor->path[level].page_num;
+    void* parent_node = get_page(table->pager, parent_page_num);
+    uint32_t num_keys_in_parent = *(internal_node_num_keys(parent_node));
+
+    if(num_keys_in_parent >= INTERNAL_NODE_MAX_CELLS){
+        internal_node_split_and_insert(cursor, level, left_child_max_key, new_child_page_num);
+        return;
     }
 
-    void *child_node = get_page(table->pager, child_page_num);
-    // Get child node's pointer and based on whether child node is Leaf or Internal
-    // call the corresponding leaf_node_find or recursive internal_node_find fn.
-    switch(get_node_type(child_node)){
-        case NODE_LEAF:
-            return leaf_node_find(table, child_page_num, key);
-        case NODE_INTERNAL:
-            return internal_node_find(table, child_page_num, key);
+    mark_page_dirty(table->pager, parent_page_num);
+    uint32_t child_node_index = cursor->path[level].child_num;
+    uint32_t left_child_page_num = *(internal_node_child(parent_node, child_node_index));
+    internal_node_move_cells(parent_node, child_node_index + 1, parent_node, child_node_index, num_keys_in_parent - child_node_index);
+    *(internal_node_num_keys(parent_node)) += 1;
+    *(internal_node_child(parent_node, child_node_index)) = left_child_page_num;
+    *(internal_node_key(parent_node, child_node_index)) = left_child_max_key;
+    // Either the shifted entry of the left child or, if it was the right child, the right child pointer.
+    *(internal_node_child(parent_node, child_node_index + 1)) = new_child_page_num;
+}
+
+/*
+Splits the full internal node at path[level] while adding new_child_page_num after the child the
+cursor descended through, then pushes the split up the same path. All
+children (plus the new one) are laid out in key order, the lower half stays in the old page,
+the upper half moves to a new right sibling, and the max key of the lower half becomes the
+separator in the parent. The key of the last child is never stored, so it is never needed.
+*/
+void internal_node_split_and_insert(Cursor* cursor, uint32_t level, uint32_t left_child_max_key, uint32_t new_child_page_num){
+    Table *table = cursor->table;
+    Pager *pager = table->pager;
+    uint32_t old_page_num = cursor->path[level].page_num;
+    void *old_node = get_page(pager, old_page_num);
+
+    uint32_t num_keys = *(internal_node_num_keys(old_node));
+    uint32_t num_entries = num_keys + 2;
+    uint32_t *children = (uint32_t *)malloc(num_entries * sizeof(uint32_t));
+    uint32_t *keys = (uint32_t *)malloc(num_entries * sizeof(uint32_t));
+
+    uint32_t insert_index = cursor->path[level].child_num;
+    for (uint32_t src = 0, i = 0; src <= num_keys; src++, i++){
+        children[i] = *(internal_node_child(old_node, src));
+        keys[i] = src < num_keys ? *(internal_node_key(old_node, src)) : 0;
+        if(src == insert_index){
+            children[i + 1] = new_child_page_num;
+            keys[i + 1] = keys[i];
+            keys[i] = left_child_max_key;
+            i++;
         }
+    }
+
+    uint32_t new_page_num = get_new_unused_page_num(pager);
+    void *new_node = get_page(pager, new_page_num);
+    mark_page_dirty(pager, old_page_num);
+    mark_page_dirty(pager, new_page_num);
+    initialize_internal_node(new_node);
+
+    uint32_t left_entries = num_entries / 2;
+    if(cursor->right_edge && insert_index == num_keys){
+        // Growing the right edge: keep this node full and start the sibling with its last
+        // child and the new one, so the sibling has one key like any other internal node.
+        left_entries = num_entries - 2;
+    }
+    *(internal_node_num_keys(old_node)) = left_entries - 1;
+    for (uint32_t i = 0; i < left_entries - 1; i++){
+        *(internal_node_child(old_node, i)) = children[i];
+        *(internal_node_key(old_node, i)) = keys[i];
+    }
+    *(internal_node_right_child(old_node)) = children[left_entries - 1];
+    uint32_t separator_key = keys[left_entries - 1];
+
+    *(internal_node_num_keys(new_node)) = num_entries - left_entries - 1;
+    for (uint32_t i = left_entries; i < num_entries - 1; i++){
+        *(internal_node_child(new_node, i - left_entries)) = children[i];
+        *(internal_node_key(new_node, i - left_entries)) = keys[i];
+    }
+    *(internal_node_right_child(new_node)) = children[num_entries - 1];
+    free(children);
+    free(keys);
+
+    if(level == 0){
+        create_new_root(table, separator_key, new_page_num);
+    }else{
+        internal_node_insert(cursor, level - 1, separator_key, new_page_num);
+    }
 }
 
-Cursor* table_find(Table* table,uint32_t key_to_insert){
-    void *node = get_page(table->pager, table->root_page_num);
+/*
+Opens cell cell_num in a leaf with room for it: later cells shift right by one slot and the
+value takes value_size bytes off the bottom of the free space. Returns where the value goes.
+*/
+void* leaf_node_insert_cell(void* node, uint32_t cell_num, uint32_t key, uint32_t value_size){
+    uint32_t num_cells = *(leaf_node_num_cells(node));
+    memmove(leaf_node_key(node, cell_num + 1), leaf_node_key(node, cell_num), (num_cells - cell_num) * LEAF_NODE_KEY_SIZE);
+    memmove(leaf_node_slot(node, cell_num + 1), leaf_node_slot(node, cell_num), (num_cells - cell_num) * LEAF_NODE_SLOT_SIZE);
+
+    uint32_t *content_start = leaf_node_content_start(node);
+    *content_start -= value_size;
+    *(leaf_node_key(node, cell_num)) = key;
+    *(leaf_node_slot(node, cell_num)) = *content_start;
+    *(leaf_node_num_cells(node)) = num_cells + 1;
+    return node + *content_start;
+}
+
+// Closes cell cell_num, sliding the values stored below it up so the free space stays in one piece.
+void leaf_node_remove_cell(void* node, uint32_t cell_num){
+    uint32_t num_cells = *(leaf_node_num_cells(node));
+    uint16_t offset = *(leaf_node_slot(node, cell_num));
+    uint32_t value_size = payload_size(node + offset);
+    uint32_t *content_start = leaf_node_content_start(node);
+
+    memmove(node + *content_start + value_size, node + *content_start, offset - *content_start);
+    *content_start += value_size;
+    for (uint32_t i = 0; i < num_cells; i++){
+        if(*(leaf_node_slot(node, i)) < offset){
+            *(leaf_node_slot(node, i)) += value_size;
+        }
+    }
+
+    memmove(leaf_node_key(node, cell_num), leaf_node_key(node, cell_num + 1), (num_cells - cell_num - 1) * LEAF_NODE_KEY_SIZE);
+    memmove(leaf_node_slot(node, cell_num), leaf_node_slot(node, cell_num + 1), (num_cells - cell_num - 1) * LEAF_NODE_SLOT_SIZE);
+    *(leaf_node_num_cells(node)) = num_cells - 1;
+}
+
+// Copies cell src_cell of src_node into dest_node as cell dest_cell; dest_node must have room.
+void leaf_node_copy_cell(void* dest_node, uint32_t dest_cell, void* src_node, uint32_t src_cell){
+    void *value = leaf_node_value(src_node, src_cell);
+    uint32_t value_size = payload_size(value);
+    memcpy(leaf_node_insert_cell(dest_node, dest_cell, *(leaf_node_key(src_node, src_cell)), value_size), value, value_size);
+}
+
+// Update the parent node for the cursor's leaf and the new leaf split off to its right..
+void leaf_node_split_update_parent(Cursor* cursor, uint32_t new_page_num){
+    void *old_node = get_page(cursor->table->pager, cursor->page_num);
+    uint32_t old_node_new_max_key = *(leaf_node_max_key(old_node));
+    if(cursor->depth == 0){
+        return create_new_root(cursor->table, old_node_new_max_key, new_page_num);
+    }else{
+        internal_node_insert(cursor, cursor->depth - 1, old_node_new_max_key, new_page_num);
+    }
+}
+
+void leaf_node_split_and_insert(Cursor* cursor, uint32_t key, Row* row_data){
+    void *old_node = get_page(cursor->table->pager, cursor->page_num);
+    cursor->table->right_edge_valid = false;
+
+    uint32_t new_page_num = get_new_unused_page_num(cursor->table->pager);
+    void *new_node = get_page(cursor->table->pager, new_page_num);
+    mark_page_dirty(cursor->table->pager, cursor->page_num);
+    mark_page_dirty(cursor->table->pager, new_page_num);
+    initialize_leaf_node(new_node);
+
+    uint32_t next_page_num = *(leaf_next_leaf_node(old_node));
+    if(next_page_num != 0){
+        void *next_node = get_page(cursor->table->pager, next_page_num);
+        mark_page_dirty(cursor->table->pager, next_page_num);
+        *(leaf_prev_leaf_node(next_node)) = new_page_num;
+    }
+    *(leaf_next_leaf_node(new_node)) = next_page_num;
+    *(leaf_prev_leaf_node(new_node)) = cursor->page_num;
+    *(leaf_next_leaf_node(old_node)) = new_page_num;
+
+    uint32_t num_cells_old_node = *(leaf_node_num_cells(old_node));
+    if(cursor->right_edge && cursor->cell_num == num_cells_old_node){
+        /*
+        Appending past the largest key (auto-increment ids): leave the full leaf as it is and
+        start the new one with just this row, as SQLite's balance_quick does. A 50/50 split
+        here would leave every leaf half empty under sequential inserts.
+        */
+        store_row(cursor->table->pager, row_data, leaf_node_insert_cell(new_node, 0, key, local_payload_size(row_payload_size(row_data))));
+        return leaf_node_split_update_parent(cursor, new_page_num);
+    }
+
+    /*
+    Rows vary in size, so the split is by bytes: the old cells plus the new row are dealt out in
+    key order, the old leaf is refilled until it holds about half of the value bytes and the
+    rest goes to the new leaf. Both end up with at least one row.
+    */
+    void *cells = malloc(PAGE_SIZE);
+    memcpy(cells, old_node, PAGE_SIZE);
+    *(leaf_node_num_cells(old_node)) = 0;
+    *(leaf_node_content_start(old_node)) = PAGE_SIZE;
+
+    uint32_t new_row_size = local_payload_size(row_payload_size(row_data));
+    uint32_t num_entries = num_cells_old_node + 1;
+    uint32_t half_bytes = (leaf_node_used_space(cells) + new_row_size) / 2;
+    uint32_t left_bytes = 0;
+    bool to_new_node = false;
+    for (uint32_t i = 0; i < num_entries; i++){
+        uint32_t old_cell = i > cursor->cell_num ? i - 1 : i;
+        uint32_t size = i == cursor->cell_num ? new_row_size : payload_size(leaf_node_value(cells, old_cell));
+        if(i > 0 && (left_bytes + size > half_bytes || i + 1 == num_entries)){
+            to_new_node = true;
+        }
+
+        void *destination_node = to_new_node ? new_node : old_node;
+        uint32_t destination_cell = *(leaf_node_num_cells(destination_node));
+        if(i == cursor->cell_num){
+            store_row(cursor->table->pager, row_data, leaf_node_insert_cell(destination_node, destination_cell, key, size));
+        }else{
+            leaf_node_copy_cell(destination_node, destination_cell, cells, old_cell);
+        }
+        if(!to_new_node){
+            left_bytes += size;
+        }
+    }
+    free(cells);
+
+    leaf_node_split_update_parent(cursor, new_page_num);
+}
+
+void leaf_node_insert(Cursor *cursor, uint32_t key, Row* row_data){
+    void *node = get_page(cursor->table->pager, cursor->page_num);
+    uint32_t value_size = local_payload_size(row_payload_size(row_data));
+
+    if(!leaf_node_has_room(node, 1, value_size)){
+        leaf_node_split_and_insert(cursor, key, row_data);
+        return;
+    }
+
+    mark_page_dirty(cursor->table->pager, cursor->page_num);
+    store_row(cursor->table->pager, row_data, leaf_node_insert_cell(node, cursor->cell_num, key, value_size));
+}
+
+// Removes the row under the cursor from its leaf, without rebalancing.
+void leaf_node_delete(Cursor *cursor){
+    void *node = get_page(cursor->table->pager, cursor->page_num);
+    mark_page_dirty(cursor->table->pager, cursor->page_num);
+    leaf_node_free_overflow(cursor->table->pager, node, cursor->cell_num);
+    leaf_node_remove_cell(node, cursor->cell_num);
+}
+
+/*
+Drops child left_num + 1 from an internal node after its contents were merged into child
+left_num. The merged page takes over the dropped child's slot and with it the dropped child's
+upper bound, so only the left child's entry has to go.
+*/
+void internal_node_drop_right_sibling(void* node, uint32_t left_num){
+    uint32_t num_keys = *(internal_node_num_keys(node));
+    *(internal_node_child(node, left_num + 1)) = *(internal_node_child(node, left_num));
+    internal_node_move_cells(node, left_num, node, left_num + 1, num_keys - left_num - 1);
+    *(internal_node_num_keys(node)) = num_keys - 1;
+}
+
+/*
+Merges right into left when both fit in one leaf, otherwise moves rows over to the underfull
+side one at a time until it is no longer underfull. Returns true on a merge.
+*/
+bool leaf_node_rebalance(void* left, void* right, bool underflow_on_left, uint32_t* separator){
+    uint32_t right_cells = *(leaf_node_num_cells(right));
+
+    if(leaf_node_has_room(left, right_cells, leaf_node_used_space(right))){
+        for (uint32_t i = 0; i < right_cells; i++){
+            leaf_node_copy_cell(left, *(leaf_node_num_cells(left)), right, i);
+        }
+        *(leaf_next_leaf_node(left)) = *(leaf_next_leaf_node(right));
+        return true;
+    }
 
-    NodeType node_type = get_node_type(node);
-    if(node_type == NODE_LEAF){
-        return leaf_node_find(table, table->root_page_num, key_to_insert);
-    }else {
-        return internal_node_find(table, table->root_page_num, key_to_insert);
+    if(underflow_on_left){
+        while(leaf_node_underfull(left) && *(leaf_node_num_cells(right)) > 1){
+            leaf_node_copy_cell(left, *(leaf_node_num_cells(left)), right, 0);
+            leaf_node_remove_cell(right, 0);
+        }
+    }else{
+        while(leaf_node_underfull(right) && *(leaf_node_num_cells(left)) > 1){
+            uint32_t last_cell = *(leaf_node_num_cells(left)) - 1;
+            leaf_node_copy_cell(right, 0, left, last_cell);
+            leaf_node_remove_cell(left, last_cell);
+        }
+    }
+    *separator = *(leaf_node_max_key(left));
+    return false;
+}
+
+/*
+Same for two adjacent internal nodes. The separator from the parent comes down as the key of
+the left node's right child whenever that child stops being the last one.
+*/
+bool internal_node_rebalance(void* left, void* right, bool underflow_on_left, uint32_t* separator){
+    uint32_t left_keys = *(internal_node_num_keys(left));
+    uint32_t right_keys = *(internal_node_num_keys(right));
+
+    if(underflow_on_left && right_keys > INTERNAL_NODE_MIN_KEYS){
+        *(internal_node_cell(left, left_keys)) = *(internal_node_right_child(left));
+        *(internal_node_key(left, left_keys)) = *separator;
+        *(internal_node_num_keys(left)) = left_keys + 1;
+        *(internal_node_right_child(left)) = *(internal_node_child(right, 0));
+        *separator = *(internal_node_key(right, 0));
+        internal_node_move_cells(right, 0, right, 1, right_keys - 1);
+        *(internal_node_num_keys(right)) = right_keys - 1;
+        return false;
     }
+    if(!underflow_on_left && left_keys > INTERNAL_NODE_MIN_KEYS){
+        internal_node_move_cells(right, 1, right, 0, right_keys);
+        *(internal_node_cell(right, 0)) = *(internal_node_right_child(left));
+        *(internal_node_key(right, 0)) = *separator;
+        *(internal_node_num_keys(right)) = right_keys + 1;
+        *(internal_node_right_child(left)) = *(internal_node_child(left, left_keys - 1));
+        *separator = *(internal_node_key(left, left_keys - 1));
+        *(internal_node_num_keys(left)) = left_keys - 1;
+        return false;
+    }
+
+    *(internal_node_cell(left, left_keys)) = *(internal_node_right_child(left));
+    *(internal_node_key(left, left_keys)) = *separator;
+    internal_node_move_cells(left, left_keys + 1, right, 0, right_keys);
+    *(internal_node_num_keys(left)) = left_keys + 1 + right_keys;
+    *(internal_node_right_child(left)) = *(internal_node_right_child(right));
+    return true;
 }
 
-Cursor* table_start(Table* table){
+/*
+Restores the minimum fill of the node at the given level of the cursor's path (level == depth
+is the leaf) after a delete, by borrowing one entry from a sibling or merging with it. A merge
+frees a page and removes an entry from the parent, so it continues one level up; a root left
+with a single child hands the root over to that child.
+*/
+void table_rebalance(Cursor* cursor, uint32_t level){
+    Table *table = cursor->table;
+    Pager *pager = table->pager;
+    uint32_t page_num = level == cursor->depth ? cursor->page_num : cursor->path[level].page_num;
+    void *node = get_page(pager, page_num);
+    bool is_leaf = get_node_type(node) == NODE_LEAF;
+
+    if(level == 0){
+        if(!is_leaf && *(internal_node_num_keys(node)) == 0){
+            uint32_t child_page_num = *(internal_node_right_child(node));
+            void *child = get_page(pager, child_page_num);
+            mark_page_dirty(pager, child_page_num);
+            set_is_root(child, true);
+            table_set_root_page_num(table, child_page_num);
+            free_page(pager, page_num);
+            table->right_edge_valid = false;
+        }
+        return;
+    }
+    bool underfull = is_leaf ? leaf_node_underfull(node) : *(internal_node_num_keys(node)) < INTERNAL_NODE_MIN_KEYS;
+    if(!underfull){
+        return;
+    }
+
+    uint32_t parent_page_num = cursor->path[level - 1].page_num;
+    uint32_t child_num = cursor->path[level - 1].child_num;
+    void *parent = get_page(pager, parent_page_num);
+    if(*(internal_node_num_keys(parent)) == 0){
+        // Splits and bulk loads give every internal node below the root at least one key,
+        // and a merge that empties one rebalances it before going further up.
+        printf("Error: internal node %d has no keys; the tree is corrupt\n", parent_page_num);
+        exit(EXIT_FAILURE);
+    }
+
+    // Pair the node with its left sibling, or with its right one when it is the first child.
+    uint32_t left_num = child_num > 0 ? child_num - 1 : 0;
+    uint32_t left_page_num = *(internal_node_child(parent, left_num));
+    uint32_t right_page_num = *(internal_node_child(parent, left_num + 1));
+    void *left = get_page(pager, left_page_num);
+    void *right = get_page(pager, right_page_num);
+    mark_page_dirty(pager, parent_page_num);
+    mark_page_dirty(pager, left_page_num);
+    mark_page_dirty(pager, right_page_num);
+    table->right_edge_valid = false;
+
+    uint32_t *separator = internal_node_key(parent, left_num);
+    bool merged = is_leaf ? leaf_node_rebalance(left, right, child_num == left_num, separator)
+                          : internal_node_rebalance(left, right, child_num == left_num, separator);
+    if(merged){
+        uint32_t next_page_num = is_leaf ? *(leaf_next_leaf_node(left)) : 0;
+        if(next_page_num != 0){
+            void *next_node = get_page(pager, next_page_num);
+            mark_page_dirty(pager, next_page_num);
+            *(leaf_prev_leaf_node(next_node)) = left_page_num;
+        }
+        internal_node_drop_right_sibling(parent, left_num);
+        free_page(pager, right_page_num);
+        table_rebalance(cursor, level - 1);
+    }
+}
+
+// Deletes the row under a cursor positioned by table_find, then rebalances up its path.
+void table_delete(Cursor* cursor){
+    leaf_node_delete(cursor);
+    table_add_rows(cursor->table, -1);
+    table_rebalance(cursor, cursor->depth);
+}
+
+Pager* initialize_pager(char const* filename, DbOptions* options){
+    int fd = open(filename, O_RDWR | O_CREAT, S_IWUSR | S_IRUSR);
+
+    if(fd == -1){
+        printf("Error: Unable to open file \n");
+        exit(EXIT_FAILURE);
+    }
+
+    Pager *pager = (Pager *)malloc(sizeof(Pager));
+    // Replays any committed statements left in the WAL before the file size is read.
+    wal_open(&(pager->wal), filename, fd, options->commit_batch, options->commit_delay_ms);
+
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) == -1){
+        printf("Error: Unable to read file size \n");
+        exit(EXIT_FAILURE);
+    }
+    off_t file_length = file_stat.st_size;
+
+    pager->file_length = file_length;
+    pager->file_descriptor = fd;
+    pager->num_pages = file_length / PAGE_SIZE;
+
+    if (file_length % PAGE_SIZE != 0) {
+     printf("Db file is not a whole number of pages. Corrupt file.\n");
+     exit(EXIT_FAILURE);
+    }
+
+    uint32_t pool_frames = options->pool_frames;
+    if(pool_frames < MIN_POOL_FRAMES){
+        printf("Error: buffer pool needs at least %d frames\n", MIN_POOL_FRAMES);
+        exit(EXIT_FAILURE);
+    }
+
+    pager->num_frames = pool_frames;
+    pager->frames = (Frame *)malloc(pool_frames * sizeof(Frame));
+    for (uint32_t i = 0; i < pool_frames; i++){
+        pager->frames[i].data = NULL;
+        pager->frames[i].page_num = INVALID_PAGE_NUM;
+        pager->frames[i].reference_bit = false;
+        pager->frames[i].is_dirty = false;
+        pager->frames[i].in_txn = false;
+        pager->frames[i].commit_num = 0;
+        pager->frames[i].io_pending = false;
+        pager->frames[i].pin_epoch = 0;
+    }
+    pager->clock_hand = 0;
+    pager->epoch = 1;
+    pager->hits = 0;
+    pager->misses = 0;
+    pager->evictions = 0;
+    pager->pages_written = 0;
+    pager->page_table = NULL;
+    pager->page_table_size = 0;
+    grow_page_table(pager, pager->num_pages);
+    pager->txn_pages = NULL;
+    pager->txn_num_pages = 0;
+    pager->txn_capacity = 0;
+
+    pager->use_mmap = options->use_mmap;
+    pager->map_base = NULL;
+    pager->map_reserved_bytes = 0;
+    pager->mapped_pages = 0;
+    pager->map_frames = NULL;
+    pager->map_hits = 0;
+    pager->prefetches = 0;
+    memset(&(pager->io), 0, sizeof(IoEngine));
+    if(options->use_io_uring && !io_engine_setup(&(pager->io))){
+        printf("io_uring is unavailable (%d), falling back to synchronous page I/O\n", errno);
+    }
+    if(pager->use_mmap){
+        // Reserve the address range once so the mapping can grow without ever moving.
+        pager->map_reserved_bytes = (size_t)options->mmap_size_mb * 1024 * 1024;
+        pager->map_base = mmap(NULL, pager->map_reserved_bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(pager->map_base == MAP_FAILED){
+            printf("Error: reserving address space for memory-mapped pager %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+        pager_map_file(pager);
+    }
+
+    return pager;
+}
+
+// Search within a leaf: the slot holding key, or the slot it would be inserted at.
+uint32_t leaf_node_find(void* node, uint32_t key_to_insert){
+    return key_search(leaf_node_key(node, 0), *leaf_node_num_cells(node), key_to_insert);
+}
+
+/*
+Positions the caller's cursor on the leaf slot for key. The descent is a plain loop that
+records every (page, child slot) it takes, so splits can walk back up the same path.
+*/
+void table_find(Table* table, uint32_t key_to_insert, Cursor* cursor){
+    cursor->table = table;
+    cursor->end_of_table = false;
+    cursor->leaves_visited = 0;
+    cursor->ascending_leaves = true;
+    cursor->depth = 0;
+    cursor->right_edge = true;
+
+    uint32_t page_num = table->root_page_num;
+    void *node = get_page(table->pager, page_num);
+    while(get_node_type(node) == NODE_INTERNAL){
+        if(cursor->depth == CURSOR_MAX_DEPTH){
+            printf("Error: tree is deeper than %d levels\n", CURSOR_MAX_DEPTH);
+            exit(EXIT_FAILURE);
+        }
+        // Keys above the last separator fall through to the right child (slot num_keys).
+        uint32_t child_num = internal_node_find_child(node, key_to_insert);
+        cursor->path[cursor->depth].page_num = page_num;
+        cursor->path[cursor->depth].child_num = child_num;
+        cursor->depth++;
+        cursor->right_edge = cursor->right_edge && child_num == *(internal_node_num_keys(node));
+
+        page_num = *(internal_node_child(node, child_num));
+        node = get_page(table->pager, page_num);
+    }
+
+    cursor->page_num = page_num;
+    cursor->cell_num = leaf_node_find(node, key_to_insert);
+
+    // An empty rightmost leaf says nothing about the largest key, so it is never cached.
+    if(cursor->right_edge && *leaf_node_num_cells(node) > 0){
+        table->max_key = *(leaf_node_max_key(node));
+        memcpy(table->right_edge_path, cursor->path, cursor->depth * sizeof(CursorPathEntry));
+        table->right_edge_depth = cursor->depth;
+        table->right_edge_page_num = page_num;
+        table->right_edge_valid = true;
+    }
+}
+
+/*
+Positions the cursor past the last row without descending, when key is larger than every key
+in the table and the right edge cached by an earlier descent is still current.
+*/
+bool table_find_append(Table* table, uint32_t key, Cursor* cursor){
+    if(!table->right_edge_valid || key <= table->max_key){
+        return false;
+    }
+    cursor->table = table;
+    cursor->end_of_table = false;
+    cursor->leaves_visited = 0;
+    cursor->ascending_leaves = true;
+    cursor->right_edge = true;
+    cursor->depth = table->right_edge_depth;
+    memcpy(cursor->path, table->right_edge_path, cursor->depth * sizeof(CursorPathEntry));
+    cursor->page_num = table->right_edge_page_num;
+
+    void *node = get_page(table->pager, cursor->page_num);
+    cursor->cell_num = *leaf_node_num_cells(node);
+    return true;
+}
+
+void table_start(Table* table, Cursor* cursor){
     // Find the leftmost child node based on lowest value key
-    Cursor *new_cursor = table_find(table, 0);
+    table_find(table, 0, cursor);
 
-    void *node = get_page(new_cursor->table->pager, new_cursor->page_num);
+    void *node = get_page(table->pager, cursor->page_num);
     uint32_t num_cells = *leaf_node_num_cells(node);
-    new_cursor->end_of_table = (num_cells == 0);
+    cursor->end_of_table = (num_cells == 0);
+}
 
-    return new_cursor;
+// splitmix64's finalizer; its two halves drive the double hashing of the probes.
+uint64_t bloom_hash(uint32_t key){
+    uint64_t hash = key + 0x9E3779B97F4A7C15ull;
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+    return hash ^ (hash >> 31);
 }
 
-Table* open_db(const char* filename){
-    Pager *pager = initialize_pager(filename);
+void bloom_add(BloomFilter* bloom, uint32_t key){
+    // A stale filter is refilled from the leaves by its rebuild, which sees this key too.
+    if(bloom->stale){
+        return;
+    }
+    uint64_t hash = bloom_hash(key);
+    uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+    for (uint32_t i = 0; i < BLOOM_NUM_HASHES; i++){
+        uint32_t bit = (h1 + i * h2) & (bloom->num_bits - 1);
+        bloom->bits[bit / 64] |= 1ull << (bit % 64);
+    }
+    bloom->num_keys++;
+    if(bloom->num_keys > bloom->capacity){
+        bloom->stale = true;
+    }
+}
+
+bool bloom_test(BloomFilter* bloom, uint32_t key){
+    uint64_t hash = bloom_hash(key);
+    uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+    for (uint32_t i = 0; i < BLOOM_NUM_HASHES; i++){
+        uint32_t bit = (h1 + i * h2) & (bloom->num_bits - 1);
+        if(!(bloom->bits[bit / 64] & (1ull << (bit % 64)))){
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+Sizes the filter for twice the current rows and refills it from the key arrays of the leaf
+chain, so rebuilds stay rare as the table grows. Row payloads are never read.
+*/
+void bloom_rebuild(Table* table){
+    BloomFilter *bloom = table->bloom;
+    bloom->capacity = table->rows_count * 2 > BLOOM_MIN_KEYS ? table->rows_count * 2 : BLOOM_MIN_KEYS;
+    bloom->num_bits = 64;
+    while(bloom->num_bits < bloom->capacity * BLOOM_BITS_PER_KEY){
+        bloom->num_bits *= 2;
+    }
+    free(bloom->bits);
+    bloom->bits = (uint64_t *)calloc(bloom->num_bits / 64, sizeof(uint64_t));
+    bloom->num_keys = 0;
+    bloom->stale = false;
+
+    pager_release_pins(table->pager);
+    Cursor cursor;
+    table_start(table, &cursor);
+    uint32_t page_num = cursor.page_num;
+    while(page_num != 0){
+        void *node = get_page(table->pager, page_num);
+        uint32_t num_cells = *(leaf_node_num_cells(node));
+        for (uint32_t i = 0; i < num_cells; i++){
+            bloom_add(bloom, *(leaf_node_key(node, i)));
+        }
+        page_num = *(leaf_next_leaf_node(node));
+        pager_release_pins(table->pager);
+    }
+}
+
+/*
+False only if key is certainly not in the table. Called before a lookup descends, when the
+statement holds no pages yet, since a stale filter is rebuilt here first.
+*/
+bool table_may_contain(Table* table, uint32_t key){
+    BloomFilter *bloom = table->bloom;
+    if(bloom == NULL){
+        return true;
+    }
+    if(bloom->stale){
+        bloom_rebuild(table);
+    }
+    bloom->lookups++;
+    if(!bloom_test(bloom, key)){
+        bloom->skipped_descents++;
+        return false;
+    }
+    return true;
+}
+
+ExecuteResult table_insert(Table* table, Row* row_to_insert){
+    uint32_t key_to_insert = row_to_insert->id;
+    Cursor cursor;
+    if(!table_find_append(table, key_to_insert, &cursor)){
+        table_find(table, key_to_insert, &cursor);
+
+        // The cursor already sits on the slot for the key, so a past-the-end slot means no duplicate.
+        void *reqd_leaf_node = get_page(table->pager, cursor.page_num);
+        if(cursor.cell_num < *(leaf_node_num_cells(reqd_leaf_node))){
+            uint32_t present_key = *leaf_node_key(reqd_leaf_node, cursor.cell_num);
+            if(present_key == key_to_insert){
+                return EXECUTE_DUPLICATE_KEY;
+            }
+        }
+    }
+
+    leaf_node_insert(&cursor, key_to_insert, row_to_insert);
+    table_add_rows(table, 1);
+    if(table->bloom != NULL){
+        bloom_add(table->bloom, key_to_insert);
+    }
+    if(key_to_insert > table->max_key){
+        table->max_key = key_to_insert;
+    }
+
+    return EXECUTE_SUCCESS;
+}
+
+Table* open_db(const char* filename, DbOptions* options){
+    Pager *pager = initialize_pager(filename, options);
 
     Table *new_table = (Table *)malloc(sizeof(Table));
     new_table->pager = pager;
-    new_table->root_page_num = 0;
 
     if(pager->num_pages == 0){
-        // New database file. Initialize page 0 as leaf node
-        void *root_node = get_page(pager, 0);
+        // New database file. Initialize the header page, then page 1 as the root leaf node
+        void *header = get_page(pager, DB_HEADER_PAGE_NUM);
+        mark_page_dirty(pager, DB_HEADER_PAGE_NUM);
+        initialize_db_header(header);
+
+        uint32_t root_page_num = get_new_unused_page_num(pager);
+        void *root_node = get_page(pager, root_page_num);
+        mark_page_dirty(pager, root_page_num);
         initialize_leaf_node(root_node);
         set_is_root(root_node, true);
+        pager_commit(pager);
     }
 
-    return new_table;
-}
-
-void flush_page_to_disk(Pager *pager, int page_num){
-    if (pager->pages[page_num] == NULL)
-    {
-        printf("Error: NULL pages cannot be flushed to disk\n");
+    // The header is read once here; later changes go through the table_* setters.
+    void *header = get_page(pager, DB_HEADER_PAGE_NUM);
+    if(*(db_header_magic(header)) != DB_HEADER_MAGIC){
+        printf("Error: %s is not a simple_db database\n", filename);
         exit(EXIT_FAILURE);
     }
-
-    off_t offset = lseek(pager->file_descriptor, page_num * PAGE_SIZE, SEEK_SET);
-    if(offset == -1){
-        printf("Error: seeking offset for page flush to disk\n");
+    if(*(db_header_format_version(header)) != DB_FORMAT_VERSION){
+        printf("Error: %s uses format version %d, this build reads version %d\n", filename,
+               *(db_header_format_version(header)), DB_FORMAT_VERSION);
         exit(EXIT_FAILURE);
     }
-
-    ssize_t bytes_written = write(pager->file_descriptor, pager->pages[page_num], PAGE_SIZE);
-    if(bytes_written == -1){
-        printf("Error: writing pages from table to file on disk\n");
+    if(*(db_header_page_size(header)) != PAGE_SIZE){
+        printf("Error: %s uses %d byte pages, this build uses %d\n", filename, *(db_header_page_size(header)), PAGE_SIZE);
         exit(EXIT_FAILURE);
     }
+    new_table->root_page_num = *(db_header_root_page(header));
+    new_table->rows_count = *(db_header_row_count(header));
+    new_table->right_edge_valid = false;
+    new_table->bloom = NULL;
+    if(options->use_bloom){
+        // Filled from the leaves by the first lookup that needs it.
+        new_table->bloom = (BloomFilter *)calloc(1, sizeof(BloomFilter));
+        new_table->bloom->stale = true;
+    }
+    // Pages past the header's count were never committed into the tree and get reused.
+    pager->num_pages = *(db_header_page_count(header));
+
+    return new_table;
 }
 
 void truncate_file_data_in_disk(Pager *pager){
@@ -727,15 +2539,18 @@ void truncate_file_data_in_disk(Pager *pager){
 void db_close(Table *table){
     Pager *pager = table->pager;
 
-    for (uint32_t i = 0; i < pager->num_pages;i++){
-        if(pager->pages[i] == NULL){
-            continue;
-        }
-        flush_page_to_disk(pager, i);
-        free(pager->pages[i]);
-        pager->pages[i] = NULL;
+    pager_commit(pager);
+    pager_checkpoint(pager);
+    io_engine_close(&(pager->io));
+    for (uint32_t i = 0; i < pager->num_frames; i++){
+        free(pager->frames[i].data);
     }
 
+    // Everything is in the database file now, so the WAL is no longer needed.
+    close(pager->wal.file_descriptor);
+    unlink(pager->wal.filename);
+    free(pager->wal.filename);
+
     // truncate_file_data_in_disk(pager);
     ssize_t res = close(pager->file_descriptor);
     if(res == -1){
@@ -743,14 +2558,19 @@ void db_close(Table *table){
         exit(EXIT_FAILURE);
     }
 
-    for (uint32_t i = 0; i < MAX_TABLE_PAGES; i++){
-        if(pager->pages[i] != NULL){
-            free(pager->pages[i]);
-            pager->pages[i] = NULL;
-        }
+    if(pager->use_mmap){
+        munmap(pager->map_base, pager->map_reserved_bytes);
     }
 
+    free(pager->frames);
+    free(pager->page_table);
+    free(pager->txn_pages);
+    free(pager->map_frames);
     free(pager);
+    if(table->bloom != NULL){
+        free(table->bloom->bits);
+        free(table->bloom);
+    }
     free(table);
 }
 
@@ -759,6 +2579,10 @@ InputBuffer* create_new_buffer(){
     new_buffer->buffer = NULL;
     new_buffer->buffer_size = 0;
     new_buffer->text_size = 0;
+    new_buffer->pending = (char *)malloc(INPUT_READ_CHUNK);
+    new_buffer->pending_size = INPUT_READ_CHUNK;
+    new_buffer->pending_start = 0;
+    new_buffer->pending_end = 0;
 
     return new_buffer;
 }
@@ -767,29 +2591,95 @@ void print_prompt(){
     printf("simple_db > ");
 }
 
+// The end of the next complete line already read ahead from stdin, or NULL if there is none yet.
+char* input_buffer_next_line_end(InputBuffer* buffer){
+    return memchr(buffer->pending + buffer->pending_start, '\n', buffer->pending_end - buffer->pending_start);
+}
+
+/*
+Reads the next line of stdin into buffer. Input goes through read(2) into the buffer's own
+read-ahead rather than stdio, so wait_for_input knows exactly which statements are already
+waiting and which ones poll will see arrive.
+*/
 void read_data_into_buffer(InputBuffer* buffer) {
-    ssize_t bytes_read = getline(&(buffer->buffer), &(buffer->buffer_size), stdin);
+    char *line_end;
+    while((line_end = input_buffer_next_line_end(buffer)) == NULL){
+        // Keep the partial line at the front and read more behind it.
+        size_t partial = buffer->pending_end - buffer->pending_start;
+        memmove(buffer->pending, buffer->pending + buffer->pending_start, partial);
+        buffer->pending_start = 0;
+        buffer->pending_end = partial;
+        if(buffer->pending_size - partial < INPUT_READ_CHUNK){
+            buffer->pending_size *= 2;
+            buffer->pending = (char *)realloc(buffer->pending, buffer->pending_size);
+        }
 
-    if(bytes_read <= 0){
-        printf("Error reading input\n");
-        exit(EXIT_FAILURE);
+        ssize_t bytes_read = read(STDIN_FILENO, buffer->pending + partial, buffer->pending_size - partial);
+        if(bytes_read == -1 && errno == EINTR){
+            continue;
+        }
+        if(bytes_read <= 0){
+            if(partial == 0){
+                printf("Error reading input\n");
+                exit(EXIT_FAILURE);
+            }
+            // The last line of the input may have no newline; there is room for one.
+            buffer->pending[buffer->pending_end++] = '\n';
+            continue;
+        }
+        buffer->pending_end += bytes_read;
+    }
+
+    size_t line_size = line_end - (buffer->pending + buffer->pending_start);
+    if(buffer->buffer_size < line_size + 1){
+        buffer->buffer_size = line_size + 1;
+        buffer->buffer = (char *)realloc(buffer->buffer, buffer->buffer_size);
+    }
+    memcpy(buffer->buffer, buffer->pending + buffer->pending_start, line_size);
+    buffer->buffer[line_size] = 0;
+    buffer->text_size = line_size;
+    buffer->pending_start += line_size + 1;
+}
+
+/*
+While a group commit is pending, wait for the next statement no longer than the group's
+deadline. If none arrives in time the group is synced, so an idle REPL never leaves a
+commit waiting longer than the configured delay.
+*/
+void wait_for_input(Pager* pager, InputBuffer* input_buffer){
+    int deadline_ms = wal_sync_deadline_ms(&(pager->wal));
+    if(deadline_ms < 0){
+        return;
+    }
+
+    // A statement already read ahead joins the group without waiting on the fd.
+    if(deadline_ms > 0 && input_buffer_next_line_end(input_buffer) != NULL){
+        return;
+    }
+
+    fflush(stdout);
+    struct pollfd input = { .fd = STDIN_FILENO, .events = POLLIN };
+    if(deadline_ms == 0 || poll(&input, 1, deadline_ms) == 0){
+        wal_sync(&(pager->wal));
     }
-    buffer->text_size = bytes_read - 1;
-    buffer->buffer[bytes_read - 1] = 0;
 }
 
 void close_input_buffer(InputBuffer* input_buffer){
     free(input_buffer->buffer);
+    free(input_buffer->pending);
     free(input_buffer);
 }
 
 void print_constants(){
-    printf("ROW_SIZE: %d\n", ROW_SIZE);
+    printf("ROW_MAX_PAYLOAD_SIZE: %d\n", ROW_MAX_PAYLOAD_SIZE);
     printf("COMMON_NODE_HEADER_SIZE: %d\n", COMMON_NODE_HEADER_SIZE);
     printf("LEAF_NODE_HEADER_SIZE: %d\n", LEAF_NODE_HEADER_SIZE);
-    printf("LEAF_NODE_CELL_SIZE: %d\n", LEAF_NODE_CELL_SIZE);
     printf("LEAF_NODE_SPACE_FOR_CELLS: %d\n", LEAF_NODE_CELL_SPACE);
+    printf("LEAF_NODE_VALUE_SPACE: %d\n", LEAF_NODE_VALUE_SPACE);
+    printf("LEAF_NODE_MAX_LOCAL: %d\n", LEAF_NODE_MAX_LOCAL);
     printf("LEAF_NODE_MAX_CELLS: %d\n", LEAF_NODE_MAX_CELLS);
+    printf("INTERNAL_NODE_MAX_CELLS: %d\n", INTERNAL_NODE_MAX_CELLS);
+    printf("KEY_SEARCH_KERNEL: %s\n", key_search_kernel);
 }
 
 void print_btree(Table* table){
@@ -803,6 +2693,68 @@ void print_btree(Table* table){
     }
 }
 
+void print_bloom_stats(BloomFilter* bloom){
+    if(bloom == NULL){
+        printf("DISABLED (open with --bloom)\n");
+        return;
+    }
+    printf("BITS: %u\n", bloom->num_bits);
+    printf("KEYS: %u\n", bloom->num_keys);
+    printf("CAPACITY: %u\n", bloom->capacity);
+    printf("STALE: %s\n", bloom->stale ? "yes" : "no");
+    printf("LOOKUPS: %llu\n", (unsigned long long)bloom->lookups);
+    printf("SKIPPED_DESCENTS: %llu\n", (unsigned long long)bloom->skipped_descents);
+}
+
+void print_pool_stats(Pager* pager){
+    uint32_t resident_pages = 0, dirty_pages = 0;
+    for (uint32_t i = 0; i < pager->num_frames; i++){
+        if(pager->frames[i].page_num != INVALID_PAGE_NUM){
+            resident_pages++;
+            dirty_pages += pager->frames[i].is_dirty;
+        }
+    }
+    printf("FRAMES: %d\n", pager->num_frames);
+    printf("RESIDENT_PAGES: %d\n", resident_pages);
+    printf("DIRTY_PAGES: %d\n", dirty_pages);
+    printf("HITS: %llu\n", (unsigned long long)pager->hits);
+    printf("MISSES: %llu\n", (unsigned long long)pager->misses);
+    printf("EVICTIONS: %llu\n", (unsigned long long)pager->evictions);
+    printf("PAGES_WRITTEN: %llu\n", (unsigned long long)pager->pages_written);
+    if(pager->use_mmap){
+        printf("MAPPED_PAGES: %d\n", pager->mapped_pages);
+        printf("MAP_HITS: %llu\n", (unsigned long long)pager->map_hits);
+    }
+    printf("IO_ENGINE: %s\n", pager->io.enabled ? "io_uring" : "sync");
+    printf("PREFETCHES: %llu\n", (unsigned long long)pager->prefetches);
+    if(pager->io.enabled){
+        printf("ASYNC_READS: %llu\n", (unsigned long long)pager->io.reads_submitted);
+        printf("ASYNC_WRITES: %llu\n", (unsigned long long)pager->io.writes_submitted);
+    }
+}
+
+void print_db_header(Pager* pager){
+    void *header = get_page(pager, DB_HEADER_PAGE_NUM);
+    printf("FORMAT_VERSION: %d\n", *(db_header_format_version(header)));
+    printf("PAGE_SIZE: %d\n", *(db_header_page_size(header)));
+    printf("ROOT_PAGE: %d\n", *(db_header_root_page(header)));
+    printf("PAGE_COUNT: %d\n", *(db_header_page_count(header)));
+    printf("ROW_COUNT: %d\n", *(db_header_row_count(header)));
+    printf("FREELIST_HEAD: %d\n", *(db_header_freelist_head(header)));
+    printf("FREE_PAGES: %d\n", *(db_header_free_page_count(header)));
+}
+
+void print_wal_stats(Wal* wal){
+    printf("WAL_FILE: %s\n", wal->filename);
+    printf("LOGGED_PAGES: %d\n", wal->num_logged_pages);
+    printf("COMMITS: %llu\n", (unsigned long long)wal->commits);
+    printf("DURABLE_COMMITS: %llu\n", (unsigned long long)wal->durable_commit);
+    printf("SYNCS: %llu\n", (unsigned long long)wal->syncs);
+    printf("GROUP_COMMIT_MAX_BATCH: %d\n", wal->max_batch);
+    printf("GROUP_COMMIT_MAX_DELAY_MS: %d\n", wal->max_delay_ms);
+    printf("CHECKPOINTS: %llu\n", (unsigned long long)wal->checkpoints);
+}
+
 void indent(uint32_t level) {
  for (uint32_t i = 0; i < level; i++) {
    printf("  ");
@@ -810,6 +2762,8 @@ void indent(uint32_t level) {
 }
 
 void print_tree(Pager* pager, uint32_t page_num, uint32_t indentation_level) {
+ // Only this node is needed until the walk returns here, so older pages may be evicted.
+ pager_release_pins(pager);
  void* node = get_page(pager, page_num);
  uint32_t num_keys, child;
 
@@ -828,10 +2782,22 @@ void print_tree(Pager* pager, uint32_t page_num, uint32_t indentation_level) {
      indent(indentation_level);
      printf("- internal (size %d)\n", num_keys);
      if(num_keys > 0){
+        // Every child is about to be visited, so start reading all of them at once.
+        uint32_t *children = malloc((num_keys + 1) * sizeof(uint32_t));
+        for (uint32_t i = 0; i < num_keys; i++) {
+            children[i] = *internal_node_child(node, i);
+        }
+        children[num_keys] = *internal_node_right_child(node);
+        pager_prefetch_pages(pager, children, num_keys + 1);
+        free(children);
+        node = get_page(pager, page_num);
+
         for (uint32_t i = 0; i < num_keys; i++) {
             child = *internal_node_child(node, i);
             print_tree(pager, child, indentation_level + 1);
 
+            // The subtree walk may have evicted this node, so fetch it again.
+            node = get_page(pager, page_num);
             indent(indentation_level + 1);
             printf("- key %d\n", *internal_node_key(node, i));
         }
@@ -844,6 +2810,327 @@ void print_tree(Pager* pager, uint32_t page_num, uint32_t indentation_level) {
 }
 
 
+// A row read from a load file. Its strings are allocated to fit; a Row has room for the longest email.
+typedef struct {
+    uint32_t id;
+    char *username;
+    char *email;
+} BulkRow;
+
+int compare_rows_by_id(const void *a, const void *b){
+    uint32_t id_a = ((const BulkRow *)a)->id;
+    uint32_t id_b = ((const BulkRow *)b)->id;
+    return (id_a > id_b) - (id_a < id_b);
+}
+
+void free_bulk_rows(BulkRow* rows, uint32_t num_rows){
+    for (uint32_t i = 0; i < num_rows; i++){
+        free(rows[i].username);
+        free(rows[i].email);
+    }
+    free(rows);
+}
+
+void bulk_row_to_row(BulkRow* bulk_row, Row* row){
+    row->id = bulk_row->id;
+    strcpy(row->username, bulk_row->username);
+    strcpy(row->email, bulk_row->email);
+}
+
+uint32_t bulk_row_payload_size(BulkRow* row){
+    return 2 * ROW_FIELD_LENGTH_SIZE + strlen(row->username) + strlen(row->email);
+}
+
+void bulk_row_serialize(BulkRow* row, void* destination){
+    void *position = serialize_field(destination, row->username);
+    serialize_field(position, row->email);
+}
+
+/*
+Reads "id username email" lines into an array sorted by id. Returns NULL (after saying why)
+if a line is malformed or an id repeats, so a load is all or nothing.
+*/
+BulkRow* read_bulk_load_file(const char* filename, uint32_t* num_rows){
+    FILE *file = fopen(filename, "r");
+    if(file == NULL){
+        printf("Error: unable to open %s\n", filename);
+        return NULL;
+    }
+
+    uint32_t capacity = 1024;
+    BulkRow *rows = (BulkRow *)malloc(capacity * sizeof(BulkRow));
+    Row *row = (Row *)malloc(sizeof(Row));
+    *num_rows = 0;
+    char *line = NULL;
+    size_t line_size = 0;
+    uint32_t line_num = 0;
+    while(getline(&line, &line_size, file) != -1){
+        line_num++;
+        char *id_string = strtok(line, " \t\n");
+        if(id_string == NULL){
+            continue;
+        }
+        char *username = strtok(NULL, " \t\n");
+        char *email = strtok(NULL, " \t\n");
+        if(*num_rows == capacity){
+            capacity *= 2;
+            rows = (BulkRow *)realloc(rows, capacity * sizeof(BulkRow));
+        }
+        if(prepare_row(id_string, username, email, row) != PREPARE_SUCCESS){
+            printf("Error: %s line %d is not a valid row\n", filename, line_num);
+            free_bulk_rows(rows, *num_rows);
+            rows = NULL;
+            break;
+        }
+        rows[*num_rows].id = row->id;
+        rows[*num_rows].username = strdup(row->username);
+        rows[*num_rows].email = strdup(row->email);
+        (*num_rows)++;
+    }
+    free(row);
+    free(line);
+    fclose(file);
+    if(rows == NULL){
+        return NULL;
+    }
+
+    qsort(rows, *num_rows, sizeof(BulkRow), compare_rows_by_id);
+    for (uint32_t i = 1; i < *num_rows; i++){
+        if(rows[i].id == rows[i - 1].id){
+            printf("Error: %s has id %d more than once\n", filename, rows[i].id);
+            free_bulk_rows(rows, *num_rows);
+            return NULL;
+        }
+    }
+    return rows;
+}
+
+// Hands out consecutive new pages and writes them to the file in runs of BULK_LOAD_RUN_PAGES.
+typedef struct {
+    Pager *pager;
+    char *run;
+    uint32_t run_first_page_num;
+    uint32_t run_num_pages;
+} BulkWriter;
+
+void bulk_writer_flush(BulkWriter* writer){
+    if(writer->run_num_pages > 0){
+        write_pages_to_disk(writer->pager, writer->run_first_page_num, writer->run, writer->run_num_pages);
+        writer->run_first_page_num += writer->run_num_pages;
+        writer->run_num_pages = 0;
+    }
+}
+
+void* bulk_writer_next_page(BulkWriter* writer, uint32_t* page_num){
+    if(writer->run_num_pages == BULK_LOAD_RUN_PAGES){
+        bulk_writer_flush(writer);
+    }
+    *page_num = writer->run_first_page_num + writer->run_num_pages;
+    void *page = writer->run + (size_t)writer->run_num_pages * PAGE_SIZE;
+    memset(page, 0, PAGE_SIZE);
+    writer->run_num_pages++;
+    return page;
+}
+
+// How many rows from first_row on go into the next leaf: until its cells or its value space reach the fill.
+uint32_t bulk_leaf_num_rows(BulkRow* rows, uint32_t first_row, uint32_t num_rows, uint32_t cells_per_leaf, uint32_t bytes_per_leaf){
+    uint32_t num_cells = 0, used_bytes = 0;
+    while(first_row + num_cells < num_rows){
+        uint32_t value_size = local_payload_size(bulk_row_payload_size(&(rows[first_row + num_cells])));
+        if(num_cells > 0 && (num_cells + 1 > cells_per_leaf || used_bytes + value_size > bytes_per_leaf)){
+            break;
+        }
+        used_bytes += value_size;
+        num_cells++;
+    }
+    return num_cells;
+}
+
+/*
+Builds the tree for sorted rows bottom-up: leaves are packed to fill_percent in id order, then
+each internal level is packed over the level below until one node is left as the root. The
+pages are numbered past the end of the database and written straight to the file, so they
+are unreachable (and reused after a crash) until the header's root moves to them in one commit.
+The file gets all leaves first, then the overflow chains of long rows, then the internal nodes.
+*/
+void bulk_load_into_empty_table(Table* table, BulkRow* rows, uint32_t num_rows, uint32_t fill_percent){
+    Pager *pager = table->pager;
+    BulkWriter writer;
+    writer.pager = pager;
+    writer.run = malloc((size_t)BULK_LOAD_RUN_PAGES * PAGE_SIZE);
+    writer.run_first_page_num = pager->num_pages;
+    writer.run_num_pages = 0;
+
+    uint32_t cells_per_leaf = LEAF_NODE_MAX_CELLS * fill_percent / 100;
+    uint32_t bytes_per_leaf = LEAF_NODE_VALUE_SPACE * fill_percent / 100;
+    // Overflow pages are numbered right after the leaves, so count the leaves first.
+    uint32_t num_children = 0;
+    for (uint32_t row = 0; row < num_rows; num_children++){
+        row += bulk_leaf_num_rows(rows, row, num_rows, cells_per_leaf, bytes_per_leaf);
+    }
+    uint32_t num_leaves = num_children;
+    uint32_t *child_pages = (uint32_t *)malloc(num_children * sizeof(uint32_t));
+    uint32_t *child_max_keys = (uint32_t *)malloc(num_children * sizeof(uint32_t));
+    void *payload = malloc(ROW_MAX_PAYLOAD_SIZE);
+    uint32_t next_overflow_page_num = writer.run_first_page_num + num_leaves;
+
+    uint32_t next_row = 0;
+    for (uint32_t leaf = 0; leaf < num_leaves; leaf++){
+        uint32_t page_num;
+        void *node = bulk_writer_next_page(&writer, &page_num);
+        initialize_leaf_node(node);
+        set_is_root(node, num_leaves == 1);
+
+        uint32_t num_cells = bulk_leaf_num_rows(rows, next_row, num_rows, cells_per_leaf, bytes_per_leaf);
+        for (uint32_t i = 0; i < num_cells; i++, next_row++){
+            uint32_t size = bulk_row_payload_size(&(rows[next_row]));
+            void *value = leaf_node_insert_cell(node, i, rows[next_row].id, local_payload_size(size));
+            if(size <= LEAF_NODE_MAX_LOCAL){
+                bulk_row_serialize(&(rows[next_row]), value);
+                continue;
+            }
+            bulk_row_serialize(&(rows[next_row]), payload);
+            memcpy(value, payload, LEAF_NODE_SPILL_LOCAL_BYTES);
+            memcpy(value + LEAF_NODE_SPILL_LOCAL_BYTES, &next_overflow_page_num, LEAF_NODE_OVERFLOW_POINTER_SIZE);
+            next_overflow_page_num += overflow_pages_needed(size);
+        }
+        // Leaves are numbered consecutively, so the chain simply runs through the file.
+        *(leaf_next_leaf_node(node)) = leaf + 1 < num_leaves ? page_num + 1 : 0;
+        *(leaf_prev_leaf_node(node)) = leaf > 0 ? page_num - 1 : 0;
+
+        child_pages[leaf] = page_num;
+        child_max_keys[leaf] = rows[next_row - 1].id;
+    }
+
+    // The chains, in the order the leaves handed out their first pages; each runs through consecutive pages.
+    for (uint32_t row = 0; row < num_rows; row++){
+        uint32_t size = bulk_row_payload_size(&(rows[row]));
+        uint32_t num_pages = overflow_pages_needed(size);
+        bulk_row_serialize(&(rows[row]), payload);
+        for (uint32_t i = 0; i < num_pages; i++){
+            uint32_t page_num;
+            void *page = bulk_writer_next_page(&writer, &page_num);
+            uint32_t written = LEAF_NODE_SPILL_LOCAL_BYTES + i * OVERFLOW_PAGE_DATA_SIZE;
+            uint32_t chunk = size - written < OVERFLOW_PAGE_DATA_SIZE ? size - written : OVERFLOW_PAGE_DATA_SIZE;
+            memcpy(page + OVERFLOW_PAGE_DATA_OFFSET, payload + written, chunk);
+            *(overflow_next_page(page)) = i + 1 < num_pages ? page_num + 1 : 0;
+        }
+    }
+    free(payload);
+
+    // Internal nodes are never packed below the fill a delete would rebalance them back to.
+    uint32_t children_per_node = INTERNAL_NODE_MAX_CELLS * fill_percent / 100 + 1;
+    if(children_per_node < INTERNAL_NODE_MIN_KEYS + 1){
+        children_per_node = INTERNAL_NODE_MIN_KEYS + 1;
+    }
+    while(num_children > 1){
+        uint32_t num_nodes = (num_children + children_per_node - 1) / children_per_node;
+
+        // A short last node takes over the one before it when both fit in one page, and
+        // otherwise shares its children evenly with it.
+        uint32_t last_children = num_children - (num_nodes - 1) * children_per_node;
+        uint32_t second_last_children = children_per_node;
+        if(num_nodes > 1 && last_children < INTERNAL_NODE_MIN_KEYS + 1){
+            uint32_t tail_children = second_last_children + last_children;
+            if(tail_children <= INTERNAL_NODE_MAX_CELLS + 1){
+                num_nodes--;
+                last_children = tail_children;
+            }else{
+                second_last_children = tail_children - tail_children / 2;
+                last_children = tail_children / 2;
+            }
+        }
+
+        uint32_t first_child = 0;
+        for (uint32_t n = 0; n < num_nodes; n++){
+            uint32_t page_num;
+            void *node = bulk_writer_next_page(&writer, &page_num);
+            initialize_internal_node(node);
+            set_is_root(node, num_nodes == 1);
+
+            uint32_t node_children = n + 1 == num_nodes ? last_children : n + 2 == num_nodes ? second_last_children : children_per_node;
+            uint32_t last_child = first_child + node_children;
+            uint32_t num_keys = node_children - 1;
+            *(internal_node_num_keys(node)) = num_keys;
+            for (uint32_t i = 0; i < num_keys; i++){
+                *(internal_node_child(node, i)) = child_pages[first_child + i];
+                *(internal_node_key(node, i)) = child_max_keys[first_child + i];
+            }
+            *(internal_node_right_child(node)) = child_pages[last_child - 1];
+
+            // The level above is built over this one in place; n never passes first_child.
+            child_pages[n] = page_num;
+            child_max_keys[n] = child_max_keys[last_child - 1];
+            first_child = last_child;
+        }
+        num_children = num_nodes;
+    }
+    uint32_t root_page_num = child_pages[0];
+    free(child_pages);
+    free(child_max_keys);
+
+    bulk_writer_flush(&writer);
+    free(writer.run);
+    // The new pages have to be on disk before the commit that makes them reachable.
+    if(fsync(pager->file_descriptor) == -1){
+        printf("Error: syncing database file after bulk load %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t old_root_page_num = table->root_page_num;
+    void *header = get_page(pager, DB_HEADER_PAGE_NUM);
+    mark_page_dirty(pager, DB_HEADER_PAGE_NUM);
+    pager->num_pages = writer.run_first_page_num;
+    *(db_header_page_count(header)) = pager->num_pages;
+    table_set_root_page_num(table, root_page_num);
+    table_add_rows(table, num_rows);
+    free_page(pager, old_root_page_num);
+    table->right_edge_valid = false;
+}
+
+/*
+.load <file> [fill%]: an empty table is built bottom-up from the sorted rows; otherwise the
+rows are inserted one by one in id order, committing in steps as the transaction grows.
+The load is durable once it reports success.
+*/
+void table_bulk_load(Table* table, const char* filename, uint32_t fill_percent){
+    uint32_t num_rows;
+    BulkRow *rows = read_bulk_load_file(filename, &num_rows);
+    if(rows == NULL){
+        return;
+    }
+    Pager *pager = table->pager;
+    pager_release_pins(pager);
+
+    void *root = get_page(pager, table->root_page_num);
+    if(num_rows == 0){
+        printf("Loaded 0 rows\n");
+    }else if(get_node_type(root) == NODE_LEAF && *(leaf_node_num_cells(root)) == 0){
+        bulk_load_into_empty_table(table, rows, num_rows, fill_percent);
+        if(table->bloom != NULL){
+            table->bloom->stale = true;
+        }
+        printf("Loaded %d rows bottom-up\n", num_rows);
+    }else{
+        uint32_t duplicates = 0;
+        Row *row = (Row *)malloc(sizeof(Row));
+        for (uint32_t i = 0; i < num_rows; i++){
+            bulk_row_to_row(&(rows[i]), row);
+            if(table_insert(table, row) == EXECUTE_DUPLICATE_KEY){
+                duplicates++;
+            }
+            pager_release_pins(pager);
+            pager_commit_if_large(pager);
+        }
+        free(row);
+        printf("Loaded %d rows by insertion, skipped %d duplicate ids\n", num_rows - duplicates, duplicates);
+    }
+    free_bulk_rows(rows, num_rows);
+
+    pager_commit(pager);
+    wal_sync(&(pager->wal));
+}
+
 MetaCommandResult check_meta_command(InputBuffer* input_buffer, Table *table){
     if(strcmp((input_buffer->buffer), ".exit") == 0){
         close_input_buffer(input_buffer);
@@ -856,18 +3143,80 @@ MetaCommandResult check_meta_command(InputBuffer* input_buffer, Table *table){
     }else if(strcmp((input_buffer->buffer), ".btree") == 0){
         printf("Btree: \n");
         // print_btree(table);
-        print_tree(table->pager, 0, 0);
+        print_tree(table->pager, table->root_page_num, 0);
+        return META_COMMAND_SUCCESS;
+    }else if(strcmp((input_buffer->buffer), ".wal") == 0){
+        printf("Write-Ahead Log: \n");
+        print_wal_stats(&(table->pager->wal));
+        return META_COMMAND_SUCCESS;
+    }else if(strcmp((input_buffer->buffer), ".checkpoint") == 0){
+        pager_checkpoint(table->pager);
+        printf("Checkpoint complete\n");
+        return META_COMMAND_SUCCESS;
+    }else if(strcmp((input_buffer->buffer), ".header") == 0){
+        printf("Database Header: \n");
+        print_db_header(table->pager);
+        return META_COMMAND_SUCCESS;
+    }else if(strncmp((input_buffer->buffer), ".load ", 6) == 0){
+        strtok(input_buffer->buffer, " ");
+        char *load_filename = strtok(NULL, " ");
+        char *fill_string = strtok(NULL, " ");
+        int fill_percent = fill_string == NULL ? 100 : atoi(fill_string);
+        if(load_filename == NULL || fill_percent < 1 || fill_percent > 100){
+            printf("Usage: .load <file> [fill%% 1-100]\n");
+            return META_COMMAND_SUCCESS;
+        }
+        table_bulk_load(table, load_filename, fill_percent);
+        return META_COMMAND_SUCCESS;
+    }else if(strcmp((input_buffer->buffer), ".pool") == 0){
+        printf("Buffer Pool: \n");
+        print_pool_stats(table->pager);
+        return META_COMMAND_SUCCESS;
+    }else if(strcmp((input_buffer->buffer), ".bloom") == 0){
+        printf("Bloom Filter: \n");
+        print_bloom_stats(table->bloom);
         return META_COMMAND_SUCCESS;
     }
     return META_COMMAND_UNRECOGNIZED;
 }
 
-void* get_cursor_value(Cursor* cursor){
+// Reads the row under the cursor: the id from the key array, the rest from the payload.
+void cursor_read_row(Cursor* cursor, Row* row, bool with_email){
+    void *node = get_page(cursor->table->pager, cursor->page_num);
+    row->id = *(leaf_node_key(node, cursor->cell_num));
+    load_row(cursor->table->pager, leaf_node_value(node, cursor->cell_num), row, with_email);
+}
+
+/*
+Reads ahead of a sequential scan. Leaves already cached reveal where the chain goes next,
+so they are followed for free. At the first leaf that isn't cached, the walk has to stop.
+If the scan has only moved forward through the file so far, the pages right after that
+leaf are requested too, since splits and appends lay leaves out in file order.
+*/
+void cursor_read_ahead(Cursor* cursor){
+    Pager *pager = cursor->table->pager;
+    uint32_t window[READAHEAD_WINDOW_LEAVES];
+    uint32_t num_pages = 0;
     uint32_t page_num = cursor->page_num;
 
-    void *node = get_page(cursor->table->pager, page_num);
+    for (uint32_t hop = 0; hop < READAHEAD_WINDOW_LEAVES; hop++){
+        Frame *frame = lookup_frame(pager, page_num);
+        // Mapped pages may fault on access, so they are never walked, only hinted.
+        if(frame == NULL || frame->io_pending || page_num < pager->mapped_pages){
+            break;
+        }
+        page_num = *(leaf_next_leaf_node(frame->data));
+        if(page_num == 0){
+            return;
+        }
+    }
 
-    return leaf_node_value(node, cursor->cell_num);
+    window[num_pages++] = page_num;
+    while(cursor->ascending_leaves && num_pages < READAHEAD_WINDOW_LEAVES){
+        window[num_pages] = page_num + num_pages;
+        num_pages++;
+    }
+    pager_prefetch_pages(pager, window, num_pages);
 }
 
 void cursor_advance(Cursor* cursor){
@@ -876,84 +3225,266 @@ void cursor_advance(Cursor* cursor){
 
     cursor->cell_num += 1;
 
-    if ((cursor->cell_num) >= num_cells)
+    /* Advance to next leaf node, skipping empty ones as cursor_retreat does */
+    while ((cursor->cell_num) >= num_cells)
     {
-        /* Advance to next leaf node */
         uint32_t next_page_num = *(leaf_next_leaf_node(node));
         if(next_page_num == 0){
             cursor->end_of_table = true;
+            return;
         }
-        else{
-            cursor->page_num = next_page_num;
-            cursor->cell_num = 0;
+        cursor->ascending_leaves = cursor->ascending_leaves && next_page_num > cursor->page_num;
+        cursor->page_num = next_page_num;
+        cursor->cell_num = 0;
+        cursor->leaves_visited++;
+        if(cursor->leaves_visited >= READAHEAD_TRIGGER_LEAVES){
+            cursor_read_ahead(cursor);
         }
+        node = get_page(cursor->table->pager, next_page_num);
+        num_cells = *leaf_node_num_cells(node);
     }
 }
 
-uint32_t get_table_max_key_value(Pager* pager, void* node){
-    if(get_node_type(node) == NODE_INTERNAL){
-        uint32_t right_node_page_num = *(internal_node_right_child(node));
-        void *right_child_node = get_page(pager, right_node_page_num);
-        return get_table_max_key_value(pager, right_child_node);
+// Steps back one row, following the prev-leaf chain across leaves.
+void cursor_retreat(Cursor* cursor){
+    if(cursor->cell_num > 0){
+        cursor->cell_num -= 1;
+        return;
+    }
+
+    // Skips empty leaves, the same way cursor_advance does.
+    void *node = get_page(cursor->table->pager, cursor->page_num);
+    uint32_t num_cells = 0;
+    while(num_cells == 0){
+        uint32_t prev_page_num = *(leaf_prev_leaf_node(node));
+        if(prev_page_num == 0){
+            cursor->end_of_table = true;
+            return;
+        }
+        node = get_page(cursor->table->pager, prev_page_num);
+        cursor->page_num = prev_page_num;
+        num_cells = *(leaf_node_num_cells(node));
+        cursor->leaves_visited++;
     }
-    return *(leaf_node_max_key(node));
+    cursor->cell_num = num_cells - 1;
 }
 
-ExecuteResult execute_insert(Statement* statement, Table* table){
-    void *node = get_page(table->pager, table->root_page_num);
-    uint32_t num_cells = *leaf_node_num_cells(node);
+// Positions the cursor on the last row, for scans that run backwards.
+void table_end(Table* table, Cursor* cursor){
+    table_find(table, UINT32_MAX, cursor);
 
-    Row *row_to_insert = &(statement->row_data);
-    uint32_t key_to_insert = row_to_insert->id;
-    Cursor *cursor = table_find(table, key_to_insert);
+    // Park one past the rightmost leaf's last cell and step back onto it.
+    void *node = get_page(table->pager, cursor->page_num);
+    cursor->cell_num = *(leaf_node_num_cells(node));
+    cursor->end_of_table = false;
+    cursor_retreat(cursor);
+}
 
-    uint32_t table_max_key_val = get_table_max_key_value(table->pager, node);
-    if(key_to_insert <= table_max_key_val){
-        void *reqd_leaf_node = get_page(table->pager, cursor->page_num);
-        uint32_t present_key = *leaf_node_key(reqd_leaf_node, cursor->cell_num);
-        if(present_key == key_to_insert){
-            return EXECUTE_DUPLICATE_KEY;
+ExecuteResult execute_insert(Statement* statement, Table* table){
+    return table_insert(table, &(statement->row_data));
+}
+
+ExecuteResult execute_select(Statement *statement, Table* table){
+    Row row;
+    Cursor cursor;
+    table_start(table, &cursor);
+
+    pager_advise_sequential_scan(table->pager, true);
+    while(!(cursor.end_of_table)){
+        // A scan only needs the cursor's current leaf, so let the pool evict the rest.
+        pager_release_pins(table->pager);
+        cursor_read_row(&cursor, &row, statement->select_email);
+        if(statement->select_email){
+            printf("(%d, %s, %s)\n", row.id, row.username, row.email);
+        }else{
+            printf("(%d, %s)\n", row.id, row.username);
         }
+        cursor_advance(&cursor);
+    }
+    pager_advise_sequential_scan(table->pager, false);
+
+    return EXECUTE_SUCCESS;
+}
+
+/*
+The id is the key, so an update never moves a row to another place in the tree: the new
+payload replaces the old one in the same slot, and a leaf only splits if it grew too long.
+*/
+ExecuteResult execute_update(Statement *statement, Table *table){
+    uint32_t key_to_update = statement->row_data.id;
+    if(!table_may_contain(table, key_to_update)){
+        printf("Key: %d Not Found! \n", key_to_update);
+        return EXECUTE_SUCCESS;
+    }
+    Cursor cursor;
+    table_find(table, key_to_update, &cursor);
+
+    void *node = get_page(table->pager, cursor.page_num);
+    if(cursor.cell_num >= *(leaf_node_num_cells(node)) || *(leaf_node_key(node, cursor.cell_num)) != key_to_update){
+        printf("Key: %d Not Found! \n", key_to_update);
+        return EXECUTE_SUCCESS;
+    }
+
+    Row row;
+    cursor_read_row(&cursor, &row, true);
+    if(statement->set_username){
+        strcpy(row.username, statement->row_data.username);
+    }
+    if(statement->set_email){
+        strcpy(row.email, statement->row_data.email);
+    }
+    // The new row can be longer than the old one, so it goes back in as an insert into the same
+    // slot, which splits the leaf if it no longer fits.
+    mark_page_dirty(table->pager, cursor.page_num);
+    leaf_node_free_overflow(table->pager, node, cursor.cell_num);
+    leaf_node_remove_cell(node, cursor.cell_num);
+    leaf_node_insert(&cursor, key_to_update, &row);
+    printf("Updated 1 row\n");
+    return EXECUTE_SUCCESS;
+}
+
+/*
+Deletes every row with an id in [range_start, range_end]. Each row is found by a fresh descent
+so the cursor's path is current for rebalancing. Large ranges commit in steps, so unlike other
+statements they are not atomic: a crash part way through leaves the rows of the completed steps
+deleted. The output says when that happened.
+*/
+ExecuteResult execute_delete(Statement *statement, Table *table){
+    if(statement->range_start == statement->range_end && !table_may_contain(table, statement->range_start)){
+        printf("Deleted 0 rows\n");
+        return EXECUTE_SUCCESS;
     }
+    uint32_t num_deleted = 0;
+    uint64_t first_commit = table->pager->wal.commits;
+    uint32_t next_id = statement->range_start;
+    while(next_id <= statement->range_end){
+        pager_release_pins(table->pager);
+        Cursor cursor;
+        table_find(table, next_id, &cursor);
+        void *node = get_page(table->pager, cursor.page_num);
+        if(cursor.cell_num == *(leaf_node_num_cells(node))){
+            // Everything in this leaf is smaller; the next candidate starts the next non-empty leaf.
+            cursor_advance(&cursor);
+            if(cursor.end_of_table){
+                break;
+            }
+            void *next_node = get_page(table->pager, cursor.page_num);
+            uint32_t next_key = *(leaf_node_key(next_node, 0));
+            if(next_key <= next_id){
+                break;
+            }
+            next_id = next_key;
+            continue;
+        }
 
-    leaf_node_insert(cursor, key_to_insert, row_to_insert);
+        uint32_t key = *(leaf_node_key(node, cursor.cell_num));
+        if(key > statement->range_end){
+            break;
+        }
+        table_delete(&cursor);
+        num_deleted++;
+        pager_commit_if_large(table->pager);
+        if(key == UINT32_MAX){
+            break;
+        }
+        next_id = key + 1;
+    }
+    if(table->pager->wal.commits > first_commit){
+        printf("Deleted %d rows, committed in steps (a crash part way through would have kept only some deleted)\n", num_deleted);
+    }else{
+        printf("Deleted %d rows\n", num_deleted);
+    }
+    return EXECUTE_SUCCESS;
+}
 
-    free(cursor);
+/*
+"order by id" selects walk the leaf chain from one end, so "desc limit N" reads only the last
+few leaves: one descent down the right edge, then the prev-leaf chain.
+*/
+ExecuteResult execute_ordered_select(Statement *statement, Table *table){
+    Row row;
+    Cursor cursor;
+    if(statement->descending){
+        table_end(table, &cursor);
+    }else{
+        table_start(table, &cursor);
+    }
 
+    uint32_t num_rows = 0;
+    while(!(cursor.end_of_table) && num_rows < statement->limit){
+        pager_release_pins(table->pager);
+        cursor_read_row(&cursor, &row, true);
+        printf("(%d, %s, %s)\n", row.id, row.username, row.email);
+        num_rows++;
+        if(statement->descending){
+            cursor_retreat(&cursor);
+        }else{
+            cursor_advance(&cursor);
+        }
+    }
     return EXECUTE_SUCCESS;
 }
 
-ExecuteResult execute_select(Table* table){
+/*
+Seeks to the first id >= range_start with one descent, then walks the leaf chain until an id
+passes range_end, so the cost follows the number of rows returned rather than the table size.
+*/
+ExecuteResult execute_range_select(Statement *statement, Table *table){
+    if(statement->range_start > statement->range_end ||
+       (table->right_edge_valid && statement->range_start > table->max_key)){
+        return EXECUTE_SUCCESS;
+    }
+
     Row row;
-    Cursor *cursor = table_start(table);
+    Cursor cursor;
+    table_find(table, statement->range_start, &cursor);
+    void *node = get_page(table->pager, cursor.page_num);
+    uint32_t num_cells = *(leaf_node_num_cells(node));
+    if(cursor.cell_num >= num_cells){
+        if(num_cells == 0){
+            return EXECUTE_SUCCESS;
+        }
+        // Every id in this leaf is below the range; step onto the first row of the next leaf.
+        cursor.cell_num = num_cells - 1;
+        cursor_advance(&cursor);
+    }
 
-    while(!(cursor->end_of_table)){
-        void *row_slot = get_cursor_value(cursor);
-        deserialize_row_data(&row, row_slot);
+    while(!(cursor.end_of_table)){
+        pager_release_pins(table->pager);
+        cursor_read_row(&cursor, &row, true);
+        if(row.id > statement->range_end){
+            break;
+        }
         printf("(%d, %s, %s)\n", row.id, row.username, row.email);
-        cursor_advance(cursor);
+        cursor_advance(&cursor);
     }
+    return EXECUTE_SUCCESS;
+}
 
-    free(cursor);
+// The header keeps the row count, so this never touches the tree.
+ExecuteResult execute_count(Table *table){
+    printf("(%d)\n", table->rows_count);
     return EXECUTE_SUCCESS;
 }
 
 ExecuteResult execute_single_select(Statement *statement, Table *table){
-    void *node = get_page(table->pager, table->root_page_num);
     Row *row_to_search = &(statement->row_data);
     uint32_t key_to_search = row_to_search->id;
 
-    Cursor *cursor = table_find(table, key_to_search);
+    if((table->right_edge_valid && key_to_search > table->max_key) || !table_may_contain(table, key_to_search)){
+        printf("Key: %d Not Found! \n", key_to_search);
+        return EXECUTE_SUCCESS;
+    }
 
-    uint32_t table_max_key_val = get_table_max_key_value(table->pager, node);
-    if(key_to_search <= table_max_key_val){
-        void *reqd_leaf_node = get_page(table->pager, cursor->page_num);
+    Cursor cursor;
+    table_find(table, key_to_search, &cursor);
 
-        uint32_t present_key = *leaf_node_key(reqd_leaf_node, cursor->cell_num);
+    void *reqd_leaf_node = get_page(table->pager, cursor.page_num);
+    if(cursor.cell_num < *(leaf_node_num_cells(reqd_leaf_node))){
+        uint32_t present_key = *leaf_node_key(reqd_leaf_node, cursor.cell_num);
         if(present_key == key_to_search){
             Row row;
-            void *row_slot = get_cursor_value(cursor);
-            deserialize_row_data(&row, row_slot);
+            cursor_read_row(&cursor, &row, true);
             printf("(%d, %s, %s)\n", row.id, row.username, row.email);
             return EXECUTE_SUCCESS;
         }
@@ -972,10 +3503,25 @@ ExecuteResult execute_single_select(Statement *statement, Table *table){
         return execute_insert(statement, table);
     case STATEMENT_SELECT:
         printf("This will execute SELECT statement functionality... \n");
-        return execute_select(table);
+        return execute_select(statement, table);
     case STATEMENT_SINGLE_SELECT:
         printf("This will execute single SELECT statement functionality... \n");
         return execute_single_select(statement, table);
+    case STATEMENT_RANGE_SELECT:
+        printf("This will execute range SELECT statement functionality... \n");
+        return execute_range_select(statement, table);
+    case STATEMENT_ORDERED_SELECT:
+        printf("This will execute ordered SELECT statement functionality... \n");
+        return execute_ordered_select(statement, table);
+    case STATEMENT_COUNT:
+        printf("This will execute COUNT statement functionality... \n");
+        return execute_count(table);
+    case STATEMENT_DELETE:
+        printf("This will execute DELETE statement functionality... \n");
+        return execute_delete(statement, table);
+    case STATEMENT_UPDATE:
+        printf("This will execute UPDATE statement functionality... \n");
+        return execute_update(statement, table);
     }
 }
 
@@ -988,27 +3534,116 @@ PrepareResult prepare_statment(InputBuffer* input_buffer,Statement* statement){
         char* username = strtok(NULL, " ");
         char *email = strtok(NULL, " ");
 
-        if(id_string == NULL || username == NULL || email == NULL){
+        return prepare_row(id_string, username, email, &(statement->row_data));
+    }
+    else if(strncmp(input_buffer->buffer, "delete", 6) == 0){
+        statement->type = STATEMENT_DELETE;
+
+        strtok(input_buffer->buffer, " ");
+        char* where_keyword = strtok(NULL, " ");
+        char* id_keyword = strtok(NULL, " ");
+        char* operator_keyword = strtok(NULL, " ");
+        char* start_string = strtok(NULL, " ");
+        if(where_keyword == NULL || id_keyword == NULL || operator_keyword == NULL || start_string == NULL ||
+           strcmp(where_keyword, "where") != 0 || strcmp(id_keyword, "id") != 0){
+            return PREPARE_SYNTAX_ERROR;
+        }
+
+        char* end_string = start_string;
+        if(strcmp(operator_keyword, "between") == 0){
+            char* and_keyword = strtok(NULL, " ");
+            end_string = strtok(NULL, " ");
+            if(and_keyword == NULL || end_string == NULL || strcmp(and_keyword, "and") != 0){
+                return PREPARE_SYNTAX_ERROR;
+            }
+        }else if(strcmp(operator_keyword, "=") != 0){
+            return PREPARE_SYNTAX_ERROR;
+        }
+
+        int range_start = atoi(start_string);
+        int range_end = atoi(end_string);
+        if(range_start < 0 || range_end < 0){
+            return PREPARE_INVALID_ID;
+        }
+        statement->range_start = range_start;
+        statement->range_end = range_end;
+        return PREPARE_SUCCESS;
+    }
+    else if(strncmp(input_buffer->buffer, "update", 6) == 0){
+        statement->type = STATEMENT_UPDATE;
+        statement->set_username = false;
+        statement->set_email = false;
+
+        // update set username=<name>, email=<email> where id = N  (either assignment may be left out)
+        strtok(input_buffer->buffer, " ");
+        char* token = strtok(NULL, " ,");
+        if(token == NULL || strcmp(token, "set") != 0){
             return PREPARE_SYNTAX_ERROR;
         }
+        while((token = strtok(NULL, " ,")) != NULL && strcmp(token, "where") != 0){
+            if(strncmp(token, "username=", 9) == 0){
+                if(strlen(token + 9) > MAX_USERNAME_CHAR){
+                    return PREPARE_USERNAME_TOO_LONG;
+                }
+                strcpy(statement->row_data.username, token + 9);
+                statement->set_username = true;
+            }else if(strncmp(token, "email=", 6) == 0){
+                if(strlen(token + 6) > MAX_EMAIL_CHAR){
+                    return PREPARE_EMAIL_TOO_LONG;
+                }
+                strcpy(statement->row_data.email, token + 6);
+                statement->set_email = true;
+            }else{
+                return PREPARE_SYNTAX_ERROR;
+            }
+        }
 
+        char* id_keyword = strtok(NULL, " ");
+        char* equal_keyword = strtok(NULL, " ");
+        char* id_string = strtok(NULL, " ");
+        if(token == NULL || id_keyword == NULL || equal_keyword == NULL || id_string == NULL ||
+           strcmp(id_keyword, "id") != 0 || strcmp(equal_keyword, "=") != 0 ||
+           !(statement->set_username || statement->set_email)){
+            return PREPARE_SYNTAX_ERROR;
+        }
         int id = atoi(id_string);
         if (id < 0)
         {
             return PREPARE_INVALID_ID;
         }
-
-        if(strlen(username) > MAX_USERNAME_CHAR){
-            return PREPARE_USERNAME_TOO_LONG;
+        statement->row_data.id = id;
+        return PREPARE_SUCCESS;
+    }
+    else if(strcmp(input_buffer->buffer, "select count(*)") == 0){
+        statement->type = STATEMENT_COUNT;
+        return PREPARE_SUCCESS;
+    }
+    else if(strncmp(input_buffer->buffer, "select * order by ", 18) == 0){
+        // select * order by id [asc|desc] [limit N]
+        statement->type = STATEMENT_ORDERED_SELECT;
+        statement->descending = false;
+        statement->limit = UINT32_MAX;
+
+        char* id_keyword = strtok(input_buffer->buffer + 18, " ");
+        if(id_keyword == NULL || strcmp(id_keyword, "id") != 0){
+            return INVALID_PREPARE_SELECT_STATEMENT;
         }
-        if(strlen(email) > MAX_EMAIL_CHAR){
-            return PREPARE_EMAIL_TOO_LONG;
+        char* token = strtok(NULL, " ");
+        if(token != NULL && (strcmp(token, "asc") == 0 || strcmp(token, "desc") == 0)){
+            statement->descending = strcmp(token, "desc") == 0;
+            token = strtok(NULL, " ");
+        }
+        if(token != NULL){
+            char* limit_string = strtok(NULL, " ");
+            if(strcmp(token, "limit") != 0 || limit_string == NULL){
+                return INVALID_PREPARE_SELECT_STATEMENT;
+            }
+            int limit = atoi(limit_string);
+            if(limit < 0){
+                return INVALID_PREPARE_SELECT_STATEMENT;
+            }
+            statement->limit = limit;
         }
-
-        statement->row_data.id = id;
-        strcpy(statement->row_data.username, username);
-        strcpy(statement->row_data.email, email);
-
         return PREPARE_SUCCESS;
     }
     else if(strncmp(input_buffer->buffer, "select *", 8) == 0){
@@ -1021,7 +3656,7 @@ PrepareResult prepare_statment(InputBuffer* input_buffer,Statement* statement){
         char* equal_keyword = strtok(NULL, " ");
         char *id_string = strtok(NULL, " ");
 
-        if(strcmp(select_keyword, "select") != 0 || strcmp(star_keyword, "*") != 0 || strcmp(where_keyword, "where") != 0 || strcmp(id_keyword, "id") != 0 || strcmp(equal_keyword, "=") != 0){
+        if(id_string == NULL || strcmp(select_keyword, "select") != 0 || strcmp(star_keyword, "*") != 0 || strcmp(where_keyword, "where") != 0 || strcmp(id_keyword, "id") != 0){
             return INVALID_PREPARE_SELECT_STATEMENT;
         }
 
@@ -1031,12 +3666,38 @@ PrepareResult prepare_statment(InputBuffer* input_buffer,Statement* statement){
             return PREPARE_INVALID_ID;
         }
 
+        // select * where id between A and B
+        if(strcmp(equal_keyword, "between") == 0){
+            char* and_keyword = strtok(NULL, " ");
+            char* end_string = strtok(NULL, " ");
+            if(and_keyword == NULL || end_string == NULL || strcmp(and_keyword, "and") != 0){
+                return INVALID_PREPARE_SELECT_STATEMENT;
+            }
+            int end_id = atoi(end_string);
+            if(end_id < 0){
+                return PREPARE_INVALID_ID;
+            }
+            statement->type = STATEMENT_RANGE_SELECT;
+            statement->range_start = id;
+            statement->range_end = end_id;
+            return PREPARE_SUCCESS;
+        }
+        if(strcmp(equal_keyword, "=") != 0){
+            return INVALID_PREPARE_SELECT_STATEMENT;
+        }
+
         statement->row_data.id = id;
 
         return PREPARE_SUCCESS;
     }
+    else if(strcmp(input_buffer->buffer, "select id, username") == 0){
+        statement->type = STATEMENT_SELECT;
+        statement->select_email = false;
+        return PREPARE_SUCCESS;
+    }
     else if(strncmp(input_buffer->buffer, "select", 6) == 0){
         statement->type = STATEMENT_SELECT;
+        statement->select_email = true;
         return PREPARE_SUCCESS;
     }
 
@@ -1051,11 +3712,50 @@ int main(int argc, char* argv[]){
 
     char *filename = argv[1];
 
-    Table *table = open_db(filename);
+    DbOptions options;
+    options.pool_frames = DEFAULT_POOL_FRAMES;
+    options.commit_batch = 1;
+    options.commit_delay_ms = 0;
+    options.use_mmap = false;
+    options.mmap_size_mb = DEFAULT_MMAP_SIZE_MB;
+    options.use_io_uring = false;
+    options.use_bloom = false;
+    for (int i = 2; i < argc; i++){
+        if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc){
+            options.pool_frames = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "--commit-batch") == 0 && i + 1 < argc){
+            options.commit_batch = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "--commit-delay-ms") == 0 && i + 1 < argc){
+            options.commit_delay_ms = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "--io-uring") == 0){
+            options.use_io_uring = true;
+        }else if(strcmp(argv[i], "--bloom") == 0){
+            options.use_bloom = true;
+        }else if(strcmp(argv[i], "--mmap") == 0){
+            options.use_mmap = true;
+        }else if(strcmp(argv[i], "--mmap-size-mb") == 0 && i + 1 < argc){
+            options.use_mmap = true;
+            options.mmap_size_mb = atoi(argv[++i]);
+        }else{
+            printf("Error: unrecognized option %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    select_key_search_kernel();
+    Table *table = open_db(filename, &options);
     InputBuffer *input_buffer = create_new_buffer();
 
+    bool group_commit = table->pager->wal.max_batch > 1 || table->pager->wal.max_delay_ms > 0;
+    uint64_t reported_durable_commit = 0;
+
     while(true) {
         print_prompt();
+        wait_for_input(table->pager, input_buffer);
+        if(group_commit && table->pager->wal.durable_commit > reported_durable_commit){
+            reported_durable_commit = table->pager->wal.durable_commit;
+            printf("Commits up to #%llu are durable\n", (unsigned long long)reported_durable_commit);
+        }
         read_data_into_buffer(input_buffer);
         if(input_buffer->buffer[0] == '.'){
             switch(check_meta_command(input_buffer, table)){
@@ -1067,6 +3767,9 @@ int main(int argc, char* argv[]){
             }
         }
 
+        // Pages fetched by the previous statement are no longer referenced.
+        pager_release_pins(table->pager);
+
         Statement statement;
         switch(prepare_statment(input_buffer, &statement)){
             case (PREPARE_SUCCESS):
@@ -1105,6 +3808,16 @@ int main(int argc, char* argv[]){
                 printf("Error: Duplicate Key already present in table: %d \n", statement.row_data.id);
                 break;
             }
+        // Each statement is its own transaction; this is a no-op when nothing changed.
+        uint64_t commit_num = pager_commit(table->pager);
+        if(group_commit && commit_num > 0){
+            if(wal_commit_is_durable(&(table->pager->wal), commit_num)){
+                reported_durable_commit = table->pager->wal.durable_commit;
+                printf("Commits up to #%llu are durable\n", (unsigned long long)reported_durable_commit);
+            }else{
+                printf("Commit #%llu queued for group fsync\n", (unsigned long long)commit_num);
+            }
+        }
         printf("Command Executed! \n");
     }
 
@@ -1114,5 +3827,18 @@ int main(int argc, char* argv[]){
 // insert operation command: insert id(int) username(string) email(string)
 // select complete items command: select
 // select specific Id command: select * where id = 28
+// select a range of Ids command: select * where id between 10 and 20
+// select the latest rows command: select * order by id desc limit 10
+// select without reading emails (or their overflow pages) command: select id, username
+// Printing buffer pool stats Command: .pool
+// Printing Bloom filter stats Command: .bloom  (needs --bloom)
+// Bulk loading rows Command: .load rows.txt 90   (one "id username email" per line, fill% defaults to 100)
+// Deleting rows Command: delete where id = 28   or   delete where id between 10 and 20  (large ranges commit in steps, not atomically)
+// Updating a row Command: update set username=alice, email=alice@x.com where id = 28
+// Printing database header Command: .header
+// Counting rows Command: select count(*)
+// Printing write-ahead log stats Command: .wal
+// Forcing a checkpoint Command: .checkpoint
 // Printing btree structure Command: .btree
-// Exit Command: .exit
\ No newline at end of file
+// Exit Command: .exit
+// Run Command: ./spin mydb.db [--frames 256] [--commit-batch 1] [--commit-delay-ms 0] [--mmap] [--mmap-size-mb 1024] [--io-uring] [--bloom]
\ No newline at end of file